@@ -40,10 +40,12 @@ export interface SortOption {
     weight: number;
 }
 
-/** enum for the two sort modes */
+/** enum for the sort modes */
 export enum SortMode {
     fallback = 0,
-    combined = 1
+    combined = 1,
+    /** order by Pareto layer: the schedules not dominated by any other come first */
+    pareto = 2
 }
 
 /** options for the schedule evaluator */
@@ -155,6 +157,15 @@ class ScheduleEvaluator {
         return this.size === 0;
     }
 
+    /**
+     * get the index of the first schedule of the `layer`-th Pareto layer (in the pareto sort mode),
+     * or the number of schedules if there are fewer layers
+     */
+    public getLayerStart(layer: number) {
+        if (!this.Module) return 0;
+        return this.Module._getLayerStart(layer);
+    }
+
     public getRange(opt: SortOption) {
         if (!this.Module) return 1.0;
         if (opt.name == 'IamFeelingLucky') return 1.0;
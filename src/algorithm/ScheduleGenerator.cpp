@@ -4,6 +4,7 @@
  *    Note that the total number of schedules is only memory-limited. 
  *    For a typical course schedule (e.g. 7 courses, each course meets 2~3 times a week), 
  *    about 10,000,000 schedules can be generated and stored within the browser memory limit (2GB)
+ *    (GenFlag::pack stores the sections of each schedule in ceil(log2(number of sections)) bits per course instead)
  * 2. Each schedule has no more than 21845 (65536/3) meetings each week (uint16 for timeArray).
  * Additionally, only one set of schedules can be stored at a time, since all data are stored as global variables. 
  * This is not a limitation, but rather a design decision, to keep memory usage low. 
@@ -13,13 +14,46 @@
 */
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <chrono>
 #include <cstring>
 #include <iostream>
 #include <limits>
 #include <random>
+#include <string>
+#include <utility>
 #include <vector>
 
+#ifdef USE_FLATMAP
+
+#include "parallel-hashmap/parallel_hashmap/phmap.h"
+
+template <typename K, typename V>
+using HashMap = phmap::flat_hash_map<K, V>;
+template <typename K>
+using HashSet = phmap::flat_hash_set<K>;
+
+#else
+
+#include <unordered_map>
+#include <unordered_set>
+template <typename K, typename V>
+using HashMap = std::unordered_map<K, V>;
+template <typename K>
+using HashSet = std::unordered_set<K>;
+
+#endif
+
+#ifdef USE_THREADS
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#endif
+
 using namespace std;
 
 namespace ScheduleGenerator {
@@ -32,7 +66,13 @@ inline T calcOverlap(T a, T b, T c, T d) {
 
 enum SortMode {
     fallback = 0,
-    combined = 1
+    combined = 1,
+    /**
+     * order the schedules by Pareto layer over the enabled sort options. The first layer holds the schedules
+     * not dominated by any other (no worse in every option and better in one), the second one those not dominated
+     * once the first layer is removed, and so on (see `getLayerStart`). The weights are not used
+     */
+    pareto = 2
 };
 
 struct SortOption {
@@ -51,12 +91,116 @@ struct SortOption {
 
 int sortMode = SortMode::combined;
 
+/**
+ * bit flags that select the enumeration strategy used by `generate`.
+ * Flags can be combined with bitwise or. The default (0) is the plain backtracking DFS
+ */
+enum GenFlag {
+    /**
+     * store the conflicts of each section as packed 64-bit bitsets and keep, for each level of the DFS,
+     * the set of sections that are still compatible with all sections chosen so far.
+     * A branch is pruned as soon as any course not yet assigned has no allowed section left
+     */
+    forwardCheck = 1,
+    /**
+     * split the search tree at the first one or two courses and enumerate the subtrees on multiple threads.
+     * Uses the forward checking search. Results are identical to the sequential enumeration.
+     * Only runs in parallel when compiled with USE_THREADS
+     */
+    parallel = 2,
+    /**
+     * instead of the first maxNumSchedules schedules, keep the best maxNumSchedules schedules
+     * according to the sort options set before calling `generate`, using branch and bound.
+     * Uses the forward checking search. Ignored in SortMode::pareto, which has no best schedules
+     */
+    topK = 4,
+    /**
+     * assign the courses in the order of the fewest remaining sections instead of the input order.
+     * Uses the forward checking search. Schedules are still stored in the input order of the courses,
+     * but they are enumerated in a different order. Ignored by topK, whose bounds rely on the input order
+     */
+    dynamicOrder = 8,
+    /**
+     * conflict-directed backjumping: when a course runs out of sections, return directly to the deepest course
+     * responsible for it instead of the previous one, and remember the responsible assignments as a nogood
+     * so that the same dead end is rejected at once when it is reached again.
+     * Uses the forward checking search. Results are the same as without it
+     */
+    backjump = 16,
+    /**
+     * split the courses into independent components (groups of courses that never conflict with each other)
+     * and enumerate each component separately. Only the rows of the components are stored (see `factors`),
+     * and schedule i is decoded on demand as a mixed-radix index over them.
+     * Uses the forward checking search. Has no effect if there is only one component, or with topK
+     */
+    factorize = 32,
+    /**
+     * group the sections of each course with identical time arrays and conflicts into equivalence classes
+     * and only enumerate the first section of each class. The other sections are substituted on demand
+     * by `getSchedule`, and `size` returns the number of schedules after the substitution (see `classRep`).
+     * Uses the forward checking search. Ignored by topK
+     */
+    collapse = 64,
+    /**
+     * store each schedule bit-packed, each course taking ceil(log2(number of sections)) bits,
+     * instead of a full uint16_t per course (see `packedSchedules`). `getSchedule` decodes into a scratch row.
+     * Uses the forward checking search. Ignored by topK and when the schedules are factored
+     */
+    pack = 128,
+    /**
+     * do not build the time blocks of the schedules (see `blocks`) in `generate`.
+     * Only compactness and distance depend on the order of the meetings; they build the blocks of each schedule
+     * in a scratch buffer when they are evaluated. The other sort functions never need them (see `sectionClassTime`)
+     */
+    lazyBlocks = 256,
+    /**
+     * store the coefficient arrays of the sort functions as uint16_t normalized to their range (see `CoeffCache::qcoeffs`)
+     * instead of float, halving their memory. The sort reads the compact form directly. Schedules whose coefficients
+     * differ by less than 1/65535 of the range are treated as equal (and ordered by their index)
+     */
+    compactCoeffs = 512,
+    /**
+     * instead of the first maxNumSchedules schedules, draw maxNumSchedules distinct schedules uniformly at random
+     * from all valid schedules, with the seed set by `setRandomSeed`. The schedules are counted without being enumerated
+     * (see `ScheduleCounter`), and each sample is decoded from its rank, so the time hardly depends on the number of schedules.
+     * The samples are stored in the order of `generate`. Ignores the other flags, except lazyBlocks and compactCoeffs.
+     * If there are at most maxNumSchedules schedules, all of them are generated instead. If the constraints on schedules
+     * (see `Constraints`) reject nearly all draws, the schedules satisfying them are enumerated, and maxNumSchedules
+     * of them are kept uniformly at random
+     */
+    sample = 1024
+};
+
+int genFlags = 0;
+/** the seed of the random draws of GenFlag::sample */
+uint32_t randomSeed = 0;
+
+/** number of threads used by the parallel routines */
+#ifdef USE_THREADS
+int numThreads = std::max(1u, std::thread::hardware_concurrency());
+#else
+int numThreads = 1;
+#endif
+/** the evaluation and the sort of fewer schedules than this are not split among threads */
+constexpr uint32_t PARALLEL_EVAL_MIN = 1 << 16;
+
 struct CoeffCache {
     float max, min;
     /**
-     * if this is NULL, that means the coefficient for this sort option is not yet computed
+     * if this and qcoeffs are NULL, that means the coefficient for this sort option is not yet computed
      */
     float* __restrict__ coeffs = NULL;
+    /**
+     * the compact form of the coefficients (GenFlag::compactCoeffs), used instead of coeffs:
+     * round((coeff - min) / (max - min) * 65535), or 0 if max == min
+     */
+    uint16_t* __restrict__ qcoeffs = NULL;
+    /** the value of `coeffCacheClock` when the coefficients were last requested */
+    uint32_t lastUse = 0;
+
+    bool computed() const {
+        return coeffs != NULL || qcoeffs != NULL;
+    }
 };
 
 /** 
@@ -106,24 +250,38 @@ uint16_t* __restrict__ blocks = NULL;
 uint32_t count = 0;
 
 /**
- * compute the variance of class times during the week
+ * the conflict matrix packed into bitsets, used by GenFlag::forwardCheck.
+ * Bit j of the bitset of section i is set iff section i conflicts with section j.
+ * The bitset of section i is stored at i*conflictWords to (i+1)*conflictWords
+ */
+uint64_t* __restrict__ conflictBits = NULL;
+/** number of 64-bit words in the conflict bitset of each section */
+int conflictWords = 0;
+
+/**
+ * compute the variance of class times during the week from the class time of each day
  *
  * returns a higher value when the class times are unbalanced
  */
-float variance(int idx) {
-    const auto* _blocks = blocks + offsets[idx];
+inline float varianceOf(const int* __restrict__ classTime) {
     int sum = 0,
         sumSq = 0;
     for (int i = 0; i < 7; i++) {
-        int classTime = 0;
-        for (int j = _blocks[i], end = _blocks[i + 1]; j < end; j += 3) {
-            classTime += _blocks[j + 1] - _blocks[j];
-        }
-        sum += classTime;
-        sumSq += classTime * classTime;
+        sum += classTime[i];
+        sumSq += classTime[i] * classTime[i];
     }
     float mean = sum / 5.0f;
     return sumSq / 5.0f - mean * mean;
+}
+
+float variance(const uint16_t* __restrict__ _blocks, const uint16_t* __restrict__ curSchedule) {
+    int classTime[7] = {0};
+    for (int i = 0; i < 7; i++) {
+        for (int j = _blocks[i], end = _blocks[i + 1]; j < end; j += 3) {
+            classTime[i] += _blocks[j + 1] - _blocks[j];
+        }
+    }
+    return varianceOf(classTime);
 };
 
 /**
@@ -132,8 +290,7 @@ float variance(int idx) {
  *
  * The greater the time gap between classes, the greater the return value will be
  */
-float compactness(int idx) {
-    const auto* _blocks = blocks + offsets[idx];
+float compactness(const uint16_t* __restrict__ _blocks, const uint16_t* __restrict__ curSchedule) {
     int compact = 0;
     for (int i = 0; i < 7; i++) {
         for (int j = _blocks[i], end = _blocks[i + 1] - 5; j < end; j += 3) {
@@ -145,53 +302,60 @@ float compactness(int idx) {
 
 /**
  * compute overlap of the classes and the lunch time,
- * defined as the time between 11:00 and 14:00
+ * defined as the time between 11:00 and 14:00, from the overlap of each day
  *
  * The greater the overlap, the greater the return value will be
  */
-float lunchTime(int idx) {
-    const auto* _blocks = blocks + offsets[idx];
-    // 11:00 to 14:00
+inline float lunchTimeOf(const int* __restrict__ dayOverlap) {
     int totalOverlap = 0;
     for (int i = 0; i < 7; i++) {
-        int dayOverlap = 0;
+        if (dayOverlap[i] > 60) totalOverlap += dayOverlap[i];
+    }
+    return totalOverlap;
+}
+
+float lunchTime(const uint16_t* __restrict__ _blocks, const uint16_t* __restrict__ curSchedule) {
+    int dayOverlap[7] = {0};
+    for (int i = 0; i < 7; i++) {
         for (int j = _blocks[i], end = _blocks[i + 1]; j < end; j += 3) {
             // 11:00 to 14:00
-            dayOverlap += calcOverlap(660, 840, (int)_blocks[j], (int)_blocks[j + 1]);
+            dayOverlap[i] += calcOverlap(660, 840, (int)_blocks[j], (int)_blocks[j + 1]);
         }
-
-        if (dayOverlap > 60) totalOverlap += dayOverlap;
     }
-    return totalOverlap;
+    return lunchTimeOf(dayOverlap);
 };
 
 /**
- * calculate the time between the start time of the earliest class and 12:00
+ * calculate the time between the start time of the earliest class and 12:00,
+ * from the earliest start of each day (INT_MAX if the day is empty)
  *
  * For a schedule that has earlier classes, this method will return a higher number
  */
-float noEarly(int idx) {
-    const auto* _blocks = blocks + offsets[idx];
+inline float noEarlyOf(const int* __restrict__ earliest) {
     int refTime = 12 * 60;
     int total = 0;
     for (int i = 0; i < 7; i++) {
-        int start = _blocks[i],
-            end = _blocks[i + 1];
-        if (end > start) {
-            // if this day is not empty
-            int time = _blocks[start];
-            int temp = max(refTime - time, 0);
+        if (earliest[i] != std::numeric_limits<int>::max()) {
+            int temp = max(refTime - earliest[i], 0);
             total += temp * temp;
         }
     }
     return total;
 }
 
+float noEarly(const uint16_t* __restrict__ _blocks, const uint16_t* __restrict__ curSchedule) {
+    int earliest[7];
+    for (int i = 0; i < 7; i++) {
+        // if this day is not empty
+        earliest[i] = _blocks[i + 1] > _blocks[i] ? _blocks[_blocks[i]] : std::numeric_limits<int>::max();
+    }
+    return noEarlyOf(earliest);
+}
+
 /**
  * compute the sum of walking distances between each consecutive pair of classes
  */
-float distance(int idx) {
-    const auto* _blocks = blocks + offsets[idx];
+float distance(const uint16_t* __restrict__ _blocks, const uint16_t* __restrict__ curSchedule) {
     // timeMatrix is actually a flattened matrix, so matrix[i][j] = matrix[i*len+j]
     int dist = 0;
     for (int i = 0; i < 7; i++) {
@@ -209,20 +373,22 @@ float distance(int idx) {
     return dist;
 }
 
-float similarity(int idx) {
+float similarity(const uint16_t* __restrict__ _blocks, const uint16_t* __restrict__ curSchedule) {
     int sum = numCourses;
-    const auto* __restrict__ curSchedule = schedules + idx * numCourses;
     for (int j = 0; j < numCourses; j++)
         sum -= (refSchedule[j] == curSchedule[j]);
     return sum;
 }
 
 // just used for a place holder, will never be called
-float IamFeelingLucky(int idx) {
+float IamFeelingLucky(const uint16_t* __restrict__ _blocks, const uint16_t* __restrict__ curSchedule) {
     return 1.0;
 }
 
-float (*sortFunctions[])(int idx) = {
+/**
+ * each sort function takes the time blocks of a schedule (see `blocks`) and the schedule itself
+ */
+float (*sortFunctions[])(const uint16_t* __restrict__ _blocks, const uint16_t* __restrict__ curSchedule) = {
     distance,
     variance,
     compactness,
@@ -250,6 +416,34 @@ SortOption sortOptions[NUM_SORT_FUNCS];
  * coefficient cache for each sort option 
  */
 CoeffCache sortCoeffCache[NUM_SORT_FUNCS];
+/** whether the coefficients are stored in the compact form, from GenFlag::compactCoeffs of the last `generate` */
+bool compactCache = false;
+/** the maximum number of bytes of all coefficient caches, 0 for no limit (see `setCoeffCacheBudget`) */
+uint32_t coeffCacheBudget = 0;
+/** incremented on each request of coefficients, to find the least recently used caches */
+uint32_t coeffCacheClock = 0;
+
+/** free the coefficients of a cache, so that they are computed again when they are requested */
+void releaseCache(CoeffCache& cache) {
+    delete[] cache.coeffs;
+    delete[] cache.qcoeffs;
+    cache.coeffs = NULL;
+    cache.qcoeffs = NULL;
+}
+
+/**
+ * copy the enabled sort options to `out`
+ * @returns the number of enabled options
+ */
+int getEnabledOptions(SortOption* out) {
+    int enabled = 0;
+    for (int i = 0; i < NUM_SORT_FUNCS; i++) {
+        auto& option = sortOptions[i];
+        if (option.enabled)
+            out[enabled++] = option;
+    }
+    return enabled;
+}
 
 /**
  * whether the random sort option is enabled
@@ -261,302 +455,3792 @@ bool isRandom() {
     return false;
 }
 
+/** whether `generate` keeps the best schedules only (GenFlag::topK), which needs an order of the schedules */
+inline bool keepsBest() {
+    return (genFlags & GenFlag::topK) && !isRandom() && sortMode != SortMode::pareto;
+}
+
 /**
- * get the computed/cached coefficient array for a specific sorting option.
- * @param funcIdx the index of the sorting option
- * @param assign whether assign the computed/cached values to `coeffs`
- * @returns the computed/cached coefficients
+ * pack the byte matrix `conflictCache` into `conflictBits`
+ * @returns false on memory allocation failure
  */
-CoeffCache computeCoeffFor(int funcIdx) {
-    auto& cache = sortCoeffCache[funcIdx];
-    if (cache.coeffs != NULL)
-        return cache;
-
-    auto newCache = new float[count];
-    float max = -std::numeric_limits<float>::infinity(),
-            min = std::numeric_limits<float>::infinity();
-    auto evalFunc = sortFunctions[funcIdx];
-    for (int i = 0; i < count; i++) {
-        float val = (newCache[i] = evalFunc(i));
-        if (val > max) max = val;
-        if (val < min) min = val;
+bool packConflicts(int numSections, const uint8_t* __restrict__ conflictCache) {
+    /** capacity of conflictBits in words */
+    static uint32_t bitsLen = 0;
+    conflictWords = (numSections + 63) / 64;
+    uint32_t newLen = numSections * conflictWords;
+    if (newLen > bitsLen) {
+        auto* newMem = (uint64_t*)realloc(conflictBits, newLen * sizeof(uint64_t));
+        if (newMem == NULL) return false;
+        conflictBits = newMem;
+        bitsLen = newLen;
+    }
+    memset(conflictBits, 0, newLen * sizeof(uint64_t));
+    for (int i = 0; i < numSections; i++) {
+        const auto* __restrict__ row = conflictCache + i * numSections;
+        auto* __restrict__ bits = conflictBits + i * conflictWords;
+        for (int j = 0; j < numSections; j++) {
+            bits[j >> 6] |= (uint64_t)(row[j] != 0) << (j & 63);
+        }
     }
-    return (sortCoeffCache[funcIdx] = {max, min, newCache});
+    return true;
 }
 
-template <typename F>
-inline void _apply_sort(F cmpFunc) {
-    if (count > 1000) {
-        std::partial_sort(indices, indices + 1000, indices + count, cmpFunc);
-    } else {
-        std::sort(indices, indices + count, cmpFunc);
+/**
+ * @returns the index of the first set bit of `bits` in the range [from, end), or `end` if there is none
+ */
+inline int findBit(const uint64_t* __restrict__ bits, int from, int end) {
+    while (from < end) {
+        uint64_t word = bits[from >> 6] >> (from & 63);
+        if (word) return std::min(from + std::countr_zero(word), end);
+        from = (from | 63) + 1;
     }
+    return end;
 }
 
-extern "C" {
+/**
+ * @returns the number of set bits of `bits` in the range [from, end)
+ */
+inline int countBits(const uint64_t* __restrict__ bits, int from, int end) {
+    if (from >= end) return 0;
+    const int first = from >> 6, last = (end - 1) >> 6;
+    const uint64_t firstMask = ~0ULL << (from & 63), lastMask = ~0ULL >> (63 - ((end - 1) & 63));
+    if (first == last) return std::popcount(bits[first] & firstMask & lastMask);
+    int n = std::popcount(bits[first] & firstMask) + std::popcount(bits[last] & lastMask);
+    for (int w = first + 1; w < last; w++) n += std::popcount(bits[w]);
+    return n;
+}
 
 /**
- * initialize the global indices, offsets and blocks array so the sort function can use then
-*/
-void addToEval(const uint16_t* __restrict__ timeArray, const int* __restrict__ sectionLens) {
-    int offset = 0;
-    // point to the second part of the timeArray where the content is stored
-    // should not alias with timeArray, which should be only used to access the first part
-    const auto* __restrict__ timeArrayContent = timeArray + (sectionLens[numCourses]) * 8;
-    const auto* __restrict__ curSchedule = schedules;
-    // store the time and room information corresponding to curSchedule
-    auto* __restrict__ curBlock = blocks;
-    for (int i = 0; i < count; i++) {  // for each schedule
-        int bound = 8;
-        for (int j = 0; j < 7; j++) {  // sort the time blocks for each day
-            // start index of day j in curBlock
-            int s1 = (curBlock[j] = bound);
-
-            // for each section selected (for each course), extract its time blocks on day j,
-            // and insert into day j of curBlock
-            for (int k = 0; k < numCourses; k++) {
-                // offset of the time arrays
-                int _off = curSchedule[k] * 8 + j;
-                // insertion sort, fast for small arrays
-                for (int n = timeArray[_off], e2 = timeArray[_off + 1]; n < e2; n += 3, bound += 3) {
-                    int p = s1;
-                    uint16_t vToBeInserted = timeArrayContent[n];
-                    for (; p < bound; p += 3) {
-                        if (vToBeInserted < curBlock[p]) break;
-                    }
-                    // move elements 3 slots toward the end
-                    for (int m = bound - 1; m >= p; m--) curBlock[m + 3] = curBlock[m];
-                    // insert three elements at p
-                    curBlock[p] = timeArrayContent[n];
-                    curBlock[p + 1] = timeArrayContent[n + 1];
-                    curBlock[p + 2] = timeArrayContent[n + 2];
-                }
+ * the equivalence classes of sections (GenFlag::collapse): sections of the same course
+ * with identical time arrays and conflicts are interchangeable for every sort function but similarity.
+ * classRep[s] is the first section of the class of section s. Empty if the sections are not collapsed
+ */
+vector<uint16_t> classRep;
+/** bitset of the representatives of the classes, the only sections enumerated */
+vector<uint64_t> classReps;
+/**
+ * the sections of the class of representative r are classMembers[classBegin[r] .. classBegin[r] + classSize[r]),
+ * in increasing order
+ */
+vector<uint16_t> classMembers, classSize;
+vector<int> classBegin;
+
+/**
+ * group the sections into equivalence classes (see `classRep`), using the packed conflict bitsets
+ * @returns false if every class has a single section, in which case nothing is collapsed
+ */
+bool buildClasses(int numCourses, const int* __restrict__ sectionLens, const uint16_t* __restrict__ timeArray) {
+    const int numSections = sectionLens[numCourses];
+    const auto* __restrict__ timeArrayContent = timeArray + numSections * 8;
+    classRep.resize(numSections);
+    classSize.assign(numSections, 0);
+    classReps.assign(conflictWords, 0);
+    bool collapsed = false;
+    HashMap<string, int> reps;
+    vector<uint64_t> bits(conflictWords);
+    for (int i = 0; i < numCourses; i++) {
+        reps.clear();
+        for (int s = sectionLens[i]; s < sectionLens[i + 1]; s++) {
+            // key: the length of each day, the content of the time array, then the conflicts with the other courses
+            const int start = timeArray[s * 8], end = timeArray[s * 8 + 7];
+            string key((7 + end - start) * sizeof(uint16_t) + conflictWords * sizeof(uint64_t), '\0');
+            uint16_t dayLens[7];
+            for (int d = 0; d < 7; d++) dayLens[d] = timeArray[s * 8 + d + 1] - timeArray[s * 8 + d];
+            memcpy(key.data(), dayLens, sizeof(dayLens));
+            memcpy(key.data() + sizeof(dayLens), timeArrayContent + start, (end - start) * sizeof(uint16_t));
+            memcpy(bits.data(), conflictBits + s * conflictWords, conflictWords * sizeof(uint64_t));
+            for (int j = sectionLens[i]; j < sectionLens[i + 1]; j++) bits[j >> 6] &= ~(1ULL << (j & 63));
+            memcpy(key.data() + sizeof(dayLens) + (end - start) * sizeof(uint16_t), bits.data(), conflictWords * sizeof(uint64_t));
+
+            auto it = reps.emplace(std::move(key), s).first;
+            classRep[s] = it->second;
+            if (it->second == s) {
+                classReps[s >> 6] |= 1ULL << (s & 63);
+            } else {
+                collapsed = true;
             }
+            classSize[it->second]++;
         }
-        // record the current offset
-        offsets[i] = offset;
-        offset += curBlock[7] = bound;
-        // goto the next schedule
-        curBlock += bound;
-        curSchedule += numCourses;
     }
+    if (!collapsed) {
+        classRep.clear();
+        classReps.clear();
+        return false;
+    }
+    classBegin.resize(numSections);
+    classMembers.resize(numSections);
+    for (int s = 0, off = 0; s < numSections; s++) {
+        classBegin[s] = off;
+        off += classSize[s];
+    }
+    vector<int> filled(numSections, 0);
+    for (int s = 0; s < numSections; s++) classMembers[classBegin[classRep[s]] + filled[classRep[s]]++] = s;
+    return true;
 }
+
 /**
- * @param numCourses number of courses
- * @param sectionLens a prefix array that stores the number of sections in each course
- * sectionLens[i] is the total number of sections in courses 0 to i - 1 inclusive
- * sectionLens[numCourses] is the total number of sections 
- * @param conflictCache the conflict cache matrix which caches the conflict between each pair of sections.
- * To check whether section i conflicts with section j: conflictCache[i * numSections + j] (or conflictCache[j * numSections + i])
- * Can do bitpacking, but no performance improvement observed
- * @param timeArray TODO: add description.
- * @note the pointers passed in to this function should point to dynamically allocated memory. They will be freed before this function returns. 
- * @returns the number of schedules generated. Returns -1 on memory allocation failure
+ * hard constraints on the schedules, set by `setConstraints` and applied by `generate` during the search.
+ * The constraints on single sections (free days and the time window) remove the sections that violate them
+ * before the search. The number of days is checked on each partial schedule, so that a branch is pruned
+ * as soon as it meets on too many days. The gaps are only checked on complete schedules, as a later section may fill them
  */
-int generate(const int numCourses, int maxNumSchedules, const int* __restrict__ sectionLens, const uint8_t* __restrict__ conflictCache, const uint16_t* __restrict__ timeArray) {
-    ScheduleGenerator::numCourses = numCourses;
-    maxNumSchedules *= numCourses;
-    if (maxNumSchedules + numCourses > scheduleLen) {
-        // extra 1x numCourses to prevent write out of bound at computeSchedules at *!*!*
-        scheduleLen = maxNumSchedules + numCourses;
-        auto* newMem = (uint16_t*)realloc(schedules, scheduleLen * 2);
-        // handle allocation failure
-        if (newMem == NULL) return -1;
-        schedules = newMem;
+struct Constraints {
+    /** bit d set: no meeting on day d */
+    int freeDays = 0;
+    /** no meeting starts before earliest or ends after latest, in minutes since midnight */
+    int earliest = 0, latest = 24 * 60;
+    /** the maximum number of days with meetings */
+    int maxDays = 7;
+    /** the maximum total length of the gaps between the meetings of each day, summed over the days, in minutes. -1 for no limit */
+    int maxGap = -1;
+
+    /** whether any constraint is set for the current search */
+    bool active = false;
+    /** the sections that satisfy the constraints on single sections, as a bitset */
+    vector<uint64_t> allowedSections;
+    /** days[s]: bit d set if section s meets on day d */
+    vector<uint8_t> days;
+    /** dayMasks[l]: the days of the sections chosen for the first l courses, filled by `push` */
+    vector<uint8_t> dayMasks;
+    const uint16_t* __restrict__ timeArray = NULL;
+    const uint16_t* __restrict__ timeArrayContent = NULL;
+
+    bool onSections() const {
+        return freeDays != 0 || earliest > 0 || latest < 24 * 60;
     }
 
-    /** the total length of the time array that we need to allocate for schedules generated */
-    uint32_t timeLen = 0;
-    /** current course index */
-    int courseIdx = 0;
-    /** the index of the current section */
-    int sectionIdx = 0;
-    /** pointer to the current schedule */
-    auto* __restrict__ curSchedule = schedules;
-    const int numSections = sectionLens[numCourses];
-    while (true) {
-        if (courseIdx >= numCourses) {  // we have finished building the current schedule
-            // accumulate the length of the time arrays combined in each schedule
-            // and copy the current schedule to next schedule
-            for (int i = 0; i < numCourses; i++) {
-                int secIdx = (curSchedule[numCourses + i] = curSchedule[i]);  // *!*!*
-                int _off = secIdx * 8;
-                timeLen += timeArray[_off + 7] - timeArray[_off];
-            }
+    bool onSchedules() const {
+        return maxDays < 7 || maxGap >= 0;
+    }
 
-            curSchedule += numCourses;
-            if (curSchedule - schedules >= maxNumSchedules) goto end;
-            sectionIdx = curSchedule[--courseIdx] + 1;
-        }
-    next:;
-        /**
-         * when all possibilities in on class have exhausted, explore the next possibility in the previous class
-         * reset choices of the later classes to 0
-         */
-        while (sectionIdx >= sectionLens[courseIdx + 1]) {
-            // return to the previous class
-            // if all possibilities are exhausted, break out the loop
-            if (--courseIdx < 0) goto end;
+    /**
+     * compute the days and the allowed sections of a search over the given sections
+     * @note timeArray has to stay valid during the search
+     */
+    void prepare(int numCourses, int numSections, const uint16_t* __restrict__ timeArray) {
+        active = onSections() || onSchedules();
+        allowedSections.clear();
+        if (!active) return;
+        this->timeArray = timeArray;
+        timeArrayContent = timeArray + numSections * 8;
+        days.resize(numSections);
+        dayMasks.assign(numCourses + 1, 0);
+        for (int s = 0; s < numSections; s++) days[s] = daysOf(s, timeArray);
+        if (onSections()) allowedSections = sectionsAllowed(numSections, timeArray);
+    }
 
-            // explore the next possibility
-            sectionIdx = curSchedule[courseIdx] + 1;
-            for (int i = courseIdx + 1; i < numCourses; i++) curSchedule[i] = 0;
-        }
+    /** @returns the days on which section s of timeArray meets, bit d for day d */
+    static uint8_t daysOf(int s, const uint16_t* __restrict__ timeArray) {
+        uint8_t days = 0;
+        for (int d = 0; d < 7; d++) days |= (timeArray[s * 8 + d] != timeArray[s * 8 + d + 1]) << d;
+        return days;
+    }
 
-        // check conflict between the newly chosen section and the sections already in the schedule
-        int temp = sectionIdx * numSections;
-        for (int i = 0; i < courseIdx; i++) {
-            if (conflictCache[temp + curSchedule[i]]) {
-                // if conflict, increment the section index
-                ++sectionIdx;
-                goto next;
-            }
+    /** @returns the sections of a time array of numSections sections that satisfy the constraints on single sections, as a bitset */
+    vector<uint64_t> sectionsAllowed(int numSections, const uint16_t* __restrict__ timeArray) const {
+        const auto* __restrict__ content = timeArray + numSections * 8;
+        vector<uint64_t> allowed((numSections + 63) / 64, 0);
+        for (int s = 0; s < numSections; s++) {
+            bool ok = !(daysOf(s, timeArray) & freeDays);
+            for (int i = timeArray[s * 8]; i < timeArray[s * 8 + 7] && ok; i += 3) ok = content[i] >= earliest && content[i + 1] <= latest;
+            if (ok) allowed[s >> 6] |= 1ULL << (s & 63);
         }
+        return allowed;
+    }
 
-        // if the section does not conflict with any previously chosen sections,
-        // record the section and go to the next class,
-        curSchedule[courseIdx++] = sectionIdx;
-        // set choice num to be the first section of the next class
-        sectionIdx = sectionLens[courseIdx];
+    /** @returns whether section s satisfies the constraints on single sections */
+    bool allows(int s) const {
+        return allowedSections.empty() || (allowedSections[s >> 6] >> (s & 63) & 1);
     }
-end:;
-    count = (curSchedule - schedules) / numCourses;
-    timeLen += 8 * count;
 
     /**
-     * backing storage for indices, coeffs, offsets and blocks
-     */
-    static void* evalMem = NULL;
-    /**
-     * length of the evalMem in bytes
+     * choose section s for the course at `level` of a search in the input order of the courses
+     * @returns false if it is not allowed, or the schedule would meet on too many days
      */
-    static uint32_t memSize = 0;
-
-    // handle reallocation of memory
-    static_assert(sizeof(int) == sizeof(float));
-    static_assert(alignof(int) == alignof(float));
-    uint32_t newMemSize = count * 3 * sizeof(int) + timeLen * sizeof(uint16_t);
-    if (newMemSize > memSize) {
-        void* newMem = realloc(evalMem, newMemSize);
-        if (newMem == NULL) return -1;
-        evalMem = newMem;
-        memSize = newMemSize;
-        indices = (int*)evalMem;
-        coeffs = ((float*)evalMem) + count;
-        offsets = ((int*)evalMem) + 2 * count;
-        blocks = ((uint16_t*)evalMem) + 6 * count;
+    bool push(int level, int s) {
+        if (!allows(s)) return false;
+        dayMasks[level + 1] = dayMasks[level] | days[s];
+        return std::popcount((uint32_t)dayMasks[level + 1]) <= maxDays;
     }
 
-    addToEval(timeArray, sectionLens);
-
-// cleanup
-#ifndef _TEST
-    free((void*)sectionLens);
-    free((void*)conflictCache);
-    free((void*)timeArray);
-#endif
-    for (auto& cache : sortCoeffCache) {
-        if (cache.coeffs != NULL) {
-            delete[] cache.coeffs;
-            cache.coeffs = NULL;
+    /** @returns whether the complete schedule `row` satisfies the constraints on schedules */
+    bool accepts(const uint16_t* __restrict__ row, int numCourses) const {
+        if (!onSchedules()) return true;
+        uint8_t mask = 0;
+        for (int c = 0; c < numCourses; c++) mask |= days[row[c]];
+        if (std::popcount((uint32_t)mask) > maxDays) return false;
+        if (maxGap < 0) return true;
+        // the meetings of each day, as start << 16 | end, sorted by the start
+        thread_local vector<uint32_t> meetings;
+        int gaps = 0;
+        for (int d = 0; d < 7; d++) {
+            if (!(mask >> d & 1)) continue;
+            meetings.clear();
+            for (int c = 0; c < numCourses; c++) {
+                for (int i = timeArray[row[c] * 8 + d], end = timeArray[row[c] * 8 + d + 1]; i < end; i += 3)
+                    meetings.push_back((uint32_t)timeArrayContent[i] << 16 | timeArrayContent[i + 1]);
+            }
+            std::sort(meetings.begin(), meetings.end());
+            int last = meetings[0] & 0xFFFF;
+            for (uint32_t m : meetings) {
+                const int start = m >> 16, end = m & 0xFFFF;
+                if (start > last) gaps += start - last;
+                last = std::max(last, end);
+            }
+            if (gaps > maxGap) return false;
         }
+        return true;
     }
-    return count;
-}
+} constraints;
 
 /**
- * sort the array of schedules according to their quality coefficients which will be computed by `computeCoeff`
+ * Backtracking search with forward checking over the packed conflict bitsets.
+ *
+ * `allowed` keeps one bitset per level of the search: the sections that do not conflict with any of the sections
+ * chosen at the previous levels. Picking a section for a course is a single AND-NOT of its conflict bitset,
+ * and the choice is rejected right away if some later course is left without any allowed section.
+ * By default, courses are assigned in the input order and schedules are produced in the same order as the plain DFS
+ * in `generate`. With `dynamic` (GenFlag::dynamicOrder), the next course is the one with the fewest allowed sections left,
+ * so tightly constrained courses fail early instead of at the bottom of the tree.
+ *
+ * With `backjump` (GenFlag::backjump), each level keeps its conflict set: the earlier levels whose assignments
+ * removed its sections or made its subtrees fail. Once a course is exhausted without finding any schedule,
+ * the search jumps back to the deepest level of that set, and the assignments of the set are stored as a nogood.
+ * A subtree that produced schedules (or was pruned) always returns to the previous level, as skipping it would lose results.
  */
-void sort() {
-    // we start from the original order
-    // so that when the sort is performed repetitively, the result will be stable
-    for (int i = 0; i < count; i++)
-        indices[i] = i;
-    if (isRandom()) {
-        default_random_engine eng;
-        shuffle(indices, indices + count, eng);
-        return;
-    }
-    static SortOption enabledOptions[NUM_SORT_FUNCS];
-    static struct {
-        float rev;
-        float* coeffs;
-    } data[NUM_SORT_FUNCS];
-
-    int enabled = 0;
-    for (int i = 0; i < 7; i++) {
-        auto& option = sortOptions[i];
-        if (option.enabled)
-            enabledOptions[enabled++] = option;
-    }
-    if (enabled == 0) return;
+struct ForwardChecker {
+    int numCourses;
+    const int* __restrict__ sectionLens;
+    /** allowed[l * conflictWords + w]: the w-th word of the bitset of allowed sections at level l */
+    vector<uint64_t> allowed;
+    /** cursor[l]: the next section to try at level l */
+    vector<int> cursor;
+    /** row[c]: the section chosen for course c, always in the input order of the courses */
+    vector<uint16_t> row;
+    /** order[l]: the course assigned at level l. The courses not assigned yet are order[level..numCourses) */
+    vector<int> order;
+    /** the current level (number of courses assigned). The search is exhausted once it drops below minLevel */
+    int level;
+    /** the levels below are fixed by `start` */
+    int minLevel;
+    /** whether to choose the next course by the fewest remaining sections */
+    bool dynamic;
+    /** whether to use conflict-directed backjumping. Only possible with at most 64 courses */
+    bool backjump;
 
-    if (enabled == 1) {
-        // special case: only one sort option enabled
-        /** note: shadow the global */
-        const auto coeffs = computeCoeffFor(enabledOptions[0].idx).coeffs;
-        if (enabledOptions[0].reverse) {
-            _apply_sort([coeffs](int a, int b) { return coeffs[b] < coeffs[a]; });
-        } else {
-            _apply_sort([coeffs](int a, int b) { return coeffs[b] > coeffs[a]; });
-        }
-    } else if (sortMode == SortMode::combined) {
-        // for combiend sorting, we combine the coefficients from different sort options into
-        // a single array of coefficients
-        memset(coeffs, 0, count * sizeof(float));
-        for (int i = 0; i < enabled; i++) {
-            const auto& option = enabledOptions[i];
-            auto cache = computeCoeffFor(option.idx);
-            float range = cache.max - cache.min;
-            // if all of the values are the same, skip this sorting coefficient
-            if (range == 0.0)
-                continue;
+    /** confSet[l]: bitmask of the levels responsible for the failures at level l */
+    vector<uint64_t> confSet;
+    /** number of schedules found and subtrees pruned so far */
+    uint32_t fruitful;
+    /** fruitfulAt[l]: the value of `fruitful` when level l was entered */
+    vector<uint32_t> fruitfulAt;
+    /** levelOf[c]: the level at which course c was last assigned */
+    vector<int> levelOf;
+    /** courseOf[s]: the course of section s */
+    vector<uint16_t> courseOf;
+    /** the nogoods, stored as consecutive runs of sections, each run preceded by its length */
+    vector<uint16_t> nogoods;
+    /** watches[s]: the offsets in `nogoods` of the nogoods containing section s */
+    vector<vector<uint32_t>> watches;
+    /** stop recording nogoods once `nogoods` grows larger than this */
+    static constexpr uint32_t MAX_NOGOOD_SIZE = 1 << 16;
 
-            float normalizeRatio = 1 / range;
-            float weight = option.weight;
-            auto coeff = cache.coeffs;
-            // use Euclidean distance to combine multiple sorting coefficients
-            if (option.reverse) {
-                for (int i = 0; i < count; i++) {
-                    float val = (cache.max - coeff[i]) * normalizeRatio;
-                    coeffs[i] += weight * val * val;
-                }
-            } else {
-                for (int i = 0; i < count; i++) {
-                    float val = (coeff[i] - cache.min) * normalizeRatio;
-                    coeffs[i] += weight * val * val;
-                }
+    /**
+     * @param courses if not NULL, search only over these courses (in increasing order) instead of courses 0 to numCourses - 1.
+     * `row` is still indexed by the course
+     */
+    void init(int numCourses, const int* __restrict__ sectionLens, int flags = 0, const int* courses = NULL) {
+        this->numCourses = numCourses;
+        this->sectionLens = sectionLens;
+        dynamic = flags & GenFlag::dynamicOrder;
+        backjump = (flags & GenFlag::backjump) && numCourses <= 64;
+        allowed.assign((numCourses + 1) * conflictWords, ~0ULL);
+        // only the representatives of the classes can be chosen
+        if ((flags & GenFlag::collapse) && !classReps.empty()) std::copy(classReps.begin(), classReps.end(), allowed.begin());
+        // and only those that satisfy the constraints
+        for (int w = 0; w < (int)constraints.allowedSections.size(); w++) allowed[w] &= constraints.allowedSections[w];
+        cursor.assign(numCourses + 1, 0);
+        const int rowLen = courses && numCourses ? courses[numCourses - 1] + 1 : numCourses;
+        row.assign(rowLen, 0);
+        order.resize(numCourses);
+        level = minLevel = 0;
+        int best = 0, bestCount = 0;
+        for (int i = 0; i < numCourses; i++) {
+            const int c = order[i] = courses ? courses[i] : i;
+            const int n = countBits(allowed.data(), sectionLens[c], sectionLens[c + 1]);
+            // an empty course means there is no schedule at all
+            if (n == 0) level = -1;
+            if (dynamic && (i == 0 || n < bestCount)) {
+                best = i;
+                bestCount = n;
             }
         }
-        _apply_sort([](int a, int b) { return coeffs[a] < coeffs[b]; });
-    } else {
-        // if option[i] is reverse, ifReverse[i] will be -1 * weight
-        // cached array of coefficients for each enabled sort function
-        for (int i = 0; i < enabled; i++) {
-            int funcIdx = enabledOptions[i].idx;
-            data[i].coeffs = computeCoeffFor(funcIdx).coeffs;
-            data[i].rev = enabledOptions[i].reverse ? -1.0f : 1.0f;
+        if (backjump) {
+            confSet.assign(numCourses + 1, 0);
+            fruitfulAt.assign(numCourses + 1, 0);
+            levelOf.assign(rowLen, 0);
+            courseOf.resize(sectionLens[rowLen]);
+            for (int c : order) {
+                for (int j = sectionLens[c]; j < sectionLens[c + 1]; j++) courseOf[j] = c;
+            }
+            fruitful = 0;
+            nogoods.clear();
+            watches.assign(sectionLens[rowLen], {});
         }
-        _apply_sort([enabled](int a, int b) {
-            float r = 0;
-            for (int i = 0; i < enabled; i++) {
-                // calculate the difference in coefficients
-                r = data[i].rev * (data[i].coeffs[a] - data[i].coeffs[b]);
-
-                // if non-zero, returns this coefficient
-                if (r != 0.0) return r < 0;
+        if (numCourses == 0) return;
+        std::swap(order[0], order[best]);
+        cursor[0] = sectionLens[order[0]];
+    }
 
-                // otherwise, fallback to the next sort option
+    /**
+     * restrict the search to the subtree where the sections in `prefix` are chosen first, in the given order.
+     * Without `dynamic`, prefix[i] must be a section of the i-th course
+     * @returns false if the subtree is empty
+     */
+    bool start(int numCourses, const int* __restrict__ sectionLens, const uint16_t* prefix, int len, int flags = 0) {
+        init(numCourses, sectionLens, flags);
+        for (int i = 0; i < len && level >= 0; i++) {
+            const int sectionIdx = prefix[i];
+            const auto pos = std::find_if(order.begin() + i, order.end(), [&](int c) {
+                return sectionLens[c] <= sectionIdx && sectionIdx < sectionLens[c + 1];
+            });
+            if (pos == order.end()) {
+                level = -1;
+                break;
             }
-            return r < 0;
-        });
+            std::iter_swap(order.begin() + i, pos);
+            if (!(allowed[i * conflictWords + (sectionIdx >> 6)] >> (sectionIdx & 63) & 1) || !push(sectionIdx))
+                level = -1;
+        }
+        if (level < 0) return false;
+        minLevel = len;
+        return true;
     }
+
+    /**
+     * @returns the bitmask of the levels before the current one whose section conflicts with some section of `course`
+     */
+    uint64_t culprits(int course) const {
+        uint64_t mask = 0;
+        const int begin = sectionLens[course], end = sectionLens[course + 1];
+        for (int l = 0; l < level; l++) {
+            if (findBit(conflictBits + row[order[l]] * conflictWords, begin, end) < end) mask |= 1ULL << l;
+        }
+        return mask;
+    }
+
+    /**
+     * @returns the bitmask of the levels of the other sections of a nogood completed by assigning `sectionIdx`,
+     * or 0 if there is none
+     */
+    uint64_t findNogood(int sectionIdx) const {
+        for (uint32_t off : watches[sectionIdx]) {
+            uint64_t mask = 0;
+            bool hit = true;
+            for (int i = off + 1, end = off + 1 + nogoods[off]; i < end && hit; i++) {
+                const int s = nogoods[i];
+                if (s == sectionIdx) continue;
+                const int c = courseOf[s], l = levelOf[c];
+                hit = l < level && order[l] == c && row[c] == s;
+                mask |= 1ULL << l;
+            }
+            // a nogood of a single section has no culprit, but still has to be reported
+            if (hit) return mask | 1ULL << 63;
+        }
+        return 0;
+    }
+
+    /** store the assignments at the levels of `mask` as a nogood */
+    void addNogood(uint64_t mask) {
+        if (nogoods.size() >= MAX_NOGOOD_SIZE) return;
+        const uint32_t off = nogoods.size();
+        nogoods.push_back(std::popcount(mask));
+        for (; mask; mask &= mask - 1) {
+            const int s = row[order[std::countr_zero(mask)]];
+            nogoods.push_back(s);
+            watches[s].push_back(off);
+        }
+    }
+
+    /**
+     * assign `sectionIdx` to the course at the current level and go to the next level
+     * @returns false (and stays at the current level) if some later course is left without any allowed section
+     */
+    bool push(int sectionIdx) {
+        const int words = conflictWords;
+        const auto* __restrict__ cur = allowed.data() + level * words;
+        auto* __restrict__ nextAllowed = allowed.data() + (level + 1) * words;
+        const auto* __restrict__ conflict = conflictBits + sectionIdx * words;
+        if (backjump) {
+            if (uint64_t mask = findNogood(sectionIdx)) {
+                confSet[level] |= mask & ~(1ULL << 63);
+                return false;
+            }
+        }
+        if (!dynamic) {
+            // only the sections of the courses after this one are relevant for the next level
+            const int from = level + 1 < numCourses ? sectionLens[order[level + 1]] >> 6 : words;
+            for (int w = from; w < words; w++) nextAllowed[w] = cur[w] & ~conflict[w];
+            for (int i = level + 1; i < numCourses; i++) {
+                const int c = order[i];
+                if (findBit(nextAllowed, sectionLens[c], sectionLens[c + 1]) == sectionLens[c + 1]) {
+                    // the sections of course c were removed by the earlier levels together with this one
+                    if (backjump) confSet[level] |= culprits(c);
+                    return false;
+                }
+            }
+        } else {
+            for (int w = 0; w < words; w++) nextAllowed[w] = cur[w] & ~conflict[w];
+            // pick the remaining course with the fewest allowed sections, ties broken by the input order,
+            // so that the choice does not depend on the siblings visited before
+            int best = -1, bestCount = 0;
+            for (int l = level + 1; l < numCourses; l++) {
+                const int c = order[l];
+                const int n = countBits(nextAllowed, sectionLens[c], sectionLens[c + 1]);
+                if (n == 0) {
+                    if (backjump) confSet[level] |= culprits(c);
+                    return false;
+                }
+                if (best < 0 || n < bestCount || (n == bestCount && c < order[best])) {
+                    best = l;
+                    bestCount = n;
+                }
+            }
+            if (best >= 0) std::swap(order[level + 1], order[best]);
+        }
+        if (backjump) {
+            levelOf[order[level]] = level;
+            confSet[level + 1] = 0;
+            fruitfulAt[level + 1] = fruitful;
+        }
+        row[order[level++]] = sectionIdx;
+        if (level < numCourses) cursor[level] = sectionLens[order[level]];
+        return true;
+    }
+
+    /**
+     * called when all sections of the current level are exhausted: go back to the previous level,
+     * or jump back to the deepest level responsible for the failure if no schedule was found below
+     */
+    void backtrack() {
+        if (!backjump || fruitful != fruitfulAt[level]) {
+            --level;
+            return;
+        }
+        const uint64_t conf = confSet[level] | culprits(order[level]);
+        addNogood(conf);
+        if (conf == 0) {
+            // no assignment is responsible: there is no schedule at all
+            level = minLevel - 1;
+            return;
+        }
+        level = 63 - std::countl_zero(conf);
+        confSet[level] |= conf & ~(1ULL << level);
+    }
+
+    /**
+     * advance to the next schedule, which will be stored in `row`
+     * @param prune called with the new level after each assignment, with row[0..level) filled.
+     * Only valid without `dynamic`. Returns true to discard the subtree below that assignment
+     * @returns false if all schedules have been enumerated
+     */
+    template <typename Prune>
+    bool next(Prune&& prune) {
+        while (level >= minLevel) {
+            if (level == numCourses) {
+                --level;
+                ++fruitful;
+                return true;
+            }
+            const int end = sectionLens[order[level] + 1];
+            const int sectionIdx = findBit(allowed.data() + level * conflictWords, cursor[level], end);
+            if (sectionIdx >= end) {
+                // all possibilities of this course are exhausted, return to the previous one
+                backtrack();
+                continue;
+            }
+            cursor[level] = sectionIdx + 1;
+            if (push(sectionIdx) && prune(level)) {
+                --level;
+                ++fruitful;
+            }
+        }
+        return false;
+    }
+
+    bool next() {
+        return next([](int) { return false; });
+    }
+};
+
+#ifdef USE_THREADS
+/**
+ * the worker threads of `parallelFor`. They are started on first use and kept for the lifetime of the module,
+ * waiting for the next loop, so that a loop does not pay for starting threads (web workers in the browser).
+ * Tasks are dealt round-robin to per-thread queues. Each thread takes its own tasks in increasing order,
+ * and once its queue is empty, steals the last remaining task of another thread
+ */
+struct ThreadPool {
+    struct TaskQueue {
+        mutex lock;
+        deque<int> tasks;
+    };
+    vector<thread> workers;
+    /** queues[0] belongs to the calling thread, queues[i + 1] to workers[i] */
+    unique_ptr<TaskQueue[]> queues;
+    mutex lock;
+    condition_variable wake, done;
+    /** incremented for each loop, so that the workers know when a new one starts */
+    uint64_t loop = 0;
+    /** number of threads of the current loop, including the calling thread */
+    int numLoopThreads = 0;
+    /** number of workers of the current loop still running its tasks */
+    int running = 0;
+    bool stopping = false;
+    /** the body of the current loop, called with `context` and the task */
+    void (*body)(void*, int) = NULL;
+    void* context = NULL;
+
+    /** whether the current thread is a worker, in which case nested loops run sequentially */
+    static bool& isWorker() {
+        static thread_local bool worker = false;
+        return worker;
+    }
+
+    /** run the tasks of the current loop from queue `id` until every queue is empty */
+    void runTasks(int id) {
+        const int T = numLoopThreads;
+        while (true) {
+            int task = -1;
+            {
+                lock_guard<mutex> guard(queues[id].lock);
+                if (!queues[id].tasks.empty()) {
+                    task = queues[id].tasks.front();
+                    queues[id].tasks.pop_front();
+                }
+            }
+            for (int k = 1; task < 0 && k < T; k++) {
+                auto& victim = queues[(id + k) % T];
+                lock_guard<mutex> guard(victim.lock);
+                if (!victim.tasks.empty()) {
+                    task = victim.tasks.back();
+                    victim.tasks.pop_back();
+                }
+            }
+            // tasks never spawn new tasks, so we are done once every queue is empty
+            if (task < 0) return;
+            body(context, task);
+        }
+    }
+
+    void work(int id) {
+        isWorker() = true;
+        uint64_t seen = 0;
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&] { return stopping || loop != seen; });
+            if (stopping) return;
+            seen = loop;
+            if (id + 1 >= numLoopThreads) continue;
+            guard.unlock();
+            runTasks(id + 1);
+            guard.lock();
+            if (--running == 0) done.notify_one();
+        }
+    }
+
+    /** start workers until there are `num` of them. No loop is running */
+    void grow(int num) {
+        if ((int)workers.size() >= num) return;
+        {
+            lock_guard<mutex> guard(lock);
+            queues.reset(new TaskQueue[num + 1]);
+        }
+        while ((int)workers.size() < num) {
+            const int id = workers.size();
+            workers.emplace_back([this, id] { work(id); });
+        }
+    }
+
+    template <typename F>
+    void run(int T, int numTasks, F& f) {
+        grow(T - 1);
+        for (int i = 0; i < numTasks; i++) queues[i % T].tasks.push_back(i);
+        {
+            lock_guard<mutex> guard(lock);
+            body = [](void* context, int task) { (*(F*)context)(task); };
+            context = &f;
+            numLoopThreads = T;
+            running = T - 1;
+            loop++;
+        }
+        wake.notify_all();
+        runTasks(0);
+        unique_lock<mutex> guard(lock);
+        done.wait(guard, [&] { return running == 0; });
+    }
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+    }
+} threadPool;
+#endif
+
+/**
+ * run f(task) for each task in [0, numTasks) on `numThreads` threads of `threadPool`.
+ * Without USE_THREADS, or when called from a task, the tasks simply run in order on the calling thread
+ */
+template <typename F>
+void parallelFor(int numTasks, F&& f) {
+#ifdef USE_THREADS
+    const int T = std::min(numThreads, numTasks);
+    if (T > 1 && !ThreadPool::isWorker()) {
+        threadPool.run(T, numTasks, f);
+        return;
+    }
+#endif
+    for (int i = 0; i < numTasks; i++) f(i);
+}
+
+/**
+ * the bit-packed schedules (GenFlag::pack). Course c of schedule i is stored as the index of its section
+ * within the course on packWidth[c] bits, at bit i * packBits + packOffset[c].
+ * Empty if the schedules are stored as full rows in `schedules`
+ */
+vector<uint64_t> packedSchedules;
+/** packBase[c]: the first section of course c */
+vector<int> packBase;
+vector<uint8_t> packWidth;
+vector<int> packOffset;
+/** number of bits of each packed schedule */
+int packBits = 0;
+/** whether the current schedules are packed */
+bool packed = false;
+
+/** compute the layout of the packed schedules */
+void initPacking(int numCourses, const int* __restrict__ sectionLens) {
+    packBase.assign(sectionLens, sectionLens + numCourses);
+    packWidth.resize(numCourses);
+    packOffset.resize(numCourses);
+    packBits = 0;
+    for (int c = 0; c < numCourses; c++) {
+        packOffset[c] = packBits;
+        packBits += packWidth[c] = std::bit_width((unsigned)std::max(sectionLens[c + 1] - sectionLens[c] - 1, 0));
+    }
+    packedSchedules.clear();
+    packed = true;
+}
+
+/** write `row` as the packed schedule i, growing the storage if needed */
+inline void packRow(uint32_t i, const uint16_t* __restrict__ row) {
+    const uint64_t bit = (uint64_t)i * packBits;
+    // one extra word, so that a field can always be written as two words
+    const size_t words = (bit + packBits + 63) / 64 + 1;
+    if (packedSchedules.size() < words) packedSchedules.resize(words);
+    auto* __restrict__ data = packedSchedules.data();
+    for (int c = 0; c < numCourses; c++) {
+        const uint64_t p = bit + packOffset[c];
+        const uint64_t v = row[c] - packBase[c];
+        const int shift = p & 63;
+        data[p >> 6] |= v << shift;
+        if (shift) data[(p >> 6) + 1] |= v >> (64 - shift);
+    }
+}
+
+/** read the packed schedule i into `row` */
+inline void unpackRow(uint32_t i, uint16_t* __restrict__ row) {
+    const uint64_t bit = (uint64_t)i * packBits;
+    const auto* __restrict__ data = packedSchedules.data();
+    for (int c = 0; c < numCourses; c++) {
+        const uint64_t p = bit + packOffset[c];
+        const int shift = p & 63;
+        uint64_t v = data[p >> 6] >> shift;
+        if (shift) v |= data[(p >> 6) + 1] << (64 - shift);
+        row[c] = packBase[c] + (v & ((1ULL << packWidth[c]) - 1));
+    }
+}
+
+/**
+ * a contiguous range of schedules [begin, end) whose time blocks start at blocks + offset.
+ * Used to build the time blocks of each range in parallel
+ */
+struct EvalRange {
+    uint32_t begin, end;
+    int offset;
+};
+/**
+ * the ranges produced by the parallel enumeration. Empty if the schedules were enumerated sequentially
+ */
+vector<EvalRange> evalRanges;
+
+/**
+ * enumerate at most maxNumSchedules schedules in parallel (GenFlag::parallel) and write them to `schedules`.
+ *
+ * The search tree is split into one task for each valid assignment of the first one or two levels.
+ * Each task writes to its own segment. Segments are then compacted into `schedules` in task order,
+ * so the result is the same as the sequential enumeration.
+ * @returns the total length of the time arrays of the schedules written
+ */
+uint32_t generateParallel(int numCourses, int maxNumSchedules, const int* __restrict__ sectionLens,
+                          const uint16_t* __restrict__ timeArray) {
+    // the prefixes are the valid assignments of the first one or two levels of the search tree
+    ForwardChecker root;
+    root.init(numCourses, sectionLens, genFlags & (GenFlag::dynamicOrder | GenFlag::collapse));
+    const int first = numCourses ? root.order[0] : 0;
+    // split at the second level as well if the first one is too small to keep all threads busy
+    const int prefixLen = std::min(numCourses, sectionLens[first + 1] - sectionLens[first] < 4 * numThreads ? 2 : 1);
+    vector<uint16_t> prefixes;
+    const auto* __restrict__ firstAllowed = root.allowed.data();
+    const int firstEnd = sectionLens[first + 1];
+    for (int i = findBit(firstAllowed, sectionLens[first], firstEnd); prefixLen && root.level == 0 && i < firstEnd;
+         i = findBit(firstAllowed, i + 1, firstEnd)) {
+        if (prefixLen == 1) {
+            prefixes.push_back(i);
+            continue;
+        }
+        if (!root.push(i)) continue;
+        const int second = root.order[1];
+        const auto* __restrict__ secondAllowed = root.allowed.data() + conflictWords;
+        for (int j = findBit(secondAllowed, sectionLens[second], sectionLens[second + 1]); j < sectionLens[second + 1];
+             j = findBit(secondAllowed, j + 1, sectionLens[second + 1])) {
+            prefixes.push_back(i);
+            prefixes.push_back(j);
+        }
+        --root.level;
+    }
+    const int numTasks = prefixLen ? prefixes.size() / prefixLen : 1;
+    const int maxRows = maxNumSchedules / std::max(numCourses, 1);
+
+    struct Segment {
+        vector<uint16_t> schedules;
+        uint32_t timeLen = 0;
+    };
+    vector<Segment> segments(numTasks);
+    /**
+     * number of schedules found so far by each task, published periodically.
+     * The sum over the tasks before task t is a lower bound of the number of schedules that precede its results,
+     * so task t can stop as soon as it has found enough schedules to fill up the rest
+     */
+    vector<atomic<int>> found(numTasks);
+    auto rowsLeft = [&](int t) {
+        int before = 0;
+        for (int i = 0; i < t && before < maxRows; i++) before += found[i].load(memory_order_relaxed);
+        return maxRows - before;
+    };
+    parallelFor(numTasks, [&](int t) {
+        auto& seg = segments[t];
+        int rows = 0, limit = rowsLeft(t);
+        ForwardChecker checker;
+        if (limit > 0 && checker.start(numCourses, sectionLens, prefixes.data() + t * prefixLen, prefixLen, genFlags)) {
+            while (rows < limit && checker.next()) {
+                if (constraints.active && !constraints.accepts(checker.row.data(), numCourses)) continue;
+                for (int i = 0; i < numCourses; i++) {
+                    int _off = checker.row[i] * 8;
+                    seg.timeLen += timeArray[_off + 7] - timeArray[_off];
+                }
+                seg.schedules.insert(seg.schedules.end(), checker.row.begin(), checker.row.end());
+                if (++rows % 1024 == 0) {
+                    found[t].store(rows, memory_order_relaxed);
+                    limit = rowsLeft(t);
+                }
+            }
+        }
+        found[t].store(rows, memory_order_relaxed);
+    });
+
+    // compact the segments into the schedules array
+    uint32_t timeLen = 0, total = 0;
+    for (auto& seg : segments) {
+        const uint32_t rows = std::min<uint32_t>(seg.schedules.size() / std::max(numCourses, 1), maxRows - total);
+        if (rows == 0) continue;
+        if (packed) {
+            for (uint32_t r = 0; r < rows; r++) packRow(total + r, seg.schedules.data() + r * numCourses);
+        } else {
+            memcpy(schedules + total * numCourses, seg.schedules.data(), rows * numCourses * sizeof(uint16_t));
+        }
+        if (rows * numCourses < seg.schedules.size()) {
+            // the last segment is truncated, so recompute its time length
+            seg.timeLen = 0;
+            for (uint32_t i = 0; i < rows * numCourses; i++) {
+                int _off = seg.schedules[i] * 8;
+                seg.timeLen += timeArray[_off + 7] - timeArray[_off];
+            }
+        }
+        evalRanges.push_back({total, total + rows, (int)(timeLen + 8 * total)});
+        timeLen += seg.timeLen;
+        total += rows;
+        if (total >= (uint32_t)maxRows) break;
+    }
+    count = total;
+    return timeLen;
+}
+
+/**
+ * build the time blocks (see `blocks`) of the first `len` sections of `curSchedule` at `curBlock`
+ * @param timeArrayContent the second part of the timeArray where the content is stored
+ * @returns the length of the time blocks
+ */
+inline int buildBlocks(const uint16_t* __restrict__ curSchedule, int len, uint16_t* __restrict__ curBlock,
+                       const uint16_t* __restrict__ timeArray, const uint16_t* __restrict__ timeArrayContent) {
+    int bound = 8;
+    for (int j = 0; j < 7; j++) {  // sort the time blocks for each day
+        // start index of day j in curBlock
+        int s1 = (curBlock[j] = bound);
+
+        // for each section selected (for each course), extract its time blocks on day j,
+        // and insert into day j of curBlock
+        for (int k = 0; k < len; k++) {
+            // offset of the time arrays
+            int _off = curSchedule[k] * 8 + j;
+            // insertion sort, fast for small arrays
+            for (int n = timeArray[_off], e2 = timeArray[_off + 1]; n < e2; n += 3, bound += 3) {
+                int p = s1;
+                uint16_t vToBeInserted = timeArrayContent[n];
+                for (; p < bound; p += 3) {
+                    if (vToBeInserted < curBlock[p]) break;
+                }
+                // move elements 3 slots toward the end
+                for (int m = bound - 1; m >= p; m--) curBlock[m + 3] = curBlock[m];
+                // insert three elements at p
+                curBlock[p] = timeArrayContent[n];
+                curBlock[p + 1] = timeArrayContent[n + 1];
+                curBlock[p + 2] = timeArrayContent[n + 2];
+            }
+        }
+    }
+    return curBlock[7] = bound;
+}
+
+/**
+ * @returns the content of the time array with the meetings of each section on each day sorted by start time (stable).
+ * This is `timeArrayContent` itself if it is already sorted, which is the usual case, or a sorted copy otherwise
+ */
+const uint16_t* sortTimeArrayContent(const uint16_t* __restrict__ timeArray, int numSections) {
+    static vector<uint16_t> sorted;
+    const auto* __restrict__ timeArrayContent = timeArray + numSections * 8;
+    bool isSorted = true;
+    for (int s = 0; s < numSections && isSorted; s++) {
+        for (int d = 0; d < 7 && isSorted; d++) {
+            for (int j = timeArray[s * 8 + d] + 3, end = timeArray[s * 8 + d + 1]; j < end; j += 3) {
+                if (timeArrayContent[j] < timeArrayContent[j - 3]) {
+                    isSorted = false;
+                    break;
+                }
+            }
+        }
+    }
+    if (isSorted) return timeArrayContent;
+
+    const int len = numSections ? timeArray[numSections * 8 - 1] : 0;
+    sorted.assign(timeArrayContent, timeArrayContent + len);
+    vector<array<uint16_t, 3>> meetings;
+    for (int s = 0; s < numSections; s++) {
+        for (int d = 0; d < 7; d++) {
+            const int start = timeArray[s * 8 + d], end = timeArray[s * 8 + d + 1];
+            meetings.clear();
+            for (int j = start; j < end; j += 3) meetings.push_back({sorted[j], sorted[j + 1], sorted[j + 2]});
+            std::stable_sort(meetings.begin(), meetings.end(), [](const auto& a, const auto& b) { return a[0] < b[0]; });
+            for (size_t k = 0; k < meetings.size(); k++) memcpy(sorted.data() + start + k * 3, meetings[k].data(), 6);
+        }
+    }
+    return sorted.data();
+}
+
+/**
+ * Builds the time blocks (see `blocks`) of a sequence of schedules with merges instead of insertion sorts.
+ *
+ * The blocks of the first l courses of the previous schedule are kept for each l. Consecutive schedules
+ * usually share their first courses, so only the courses after the first difference are merged in,
+ * each with one two-way merge per day between the blocks so far and the (sorted) meetings of its section.
+ * Ties keep the earlier course first, so the result is identical to `buildBlocks`
+ */
+struct BlockMerger {
+    int numCourses;
+    const uint16_t* __restrict__ timeArray;
+    /** the content of the time array, sorted by `sortTimeArrayContent` */
+    const uint16_t* __restrict__ timeArrayContent;
+    /** the blocks of the first l courses of `last`, stored at levels.data() + levelOffset[l] */
+    vector<uint16_t> levels;
+    vector<int> levelOffset;
+    /** the previous schedule */
+    vector<uint16_t> last;
+    /** the levels 0 to `valid` are up to date with `last` */
+    int valid;
+
+    void init(int numCourses, const int* __restrict__ sectionLens, const uint16_t* __restrict__ timeArray,
+              const uint16_t* __restrict__ timeArrayContent) {
+        this->numCourses = numCourses;
+        this->timeArray = timeArray;
+        this->timeArrayContent = timeArrayContent;
+        // the blocks of level l are at most as long as the longest sections of the first l courses
+        levelOffset.assign(numCourses + 1, 0);
+        int len = 8;
+        for (int c = 0; c < numCourses; c++) {
+            int maxLen = 0;
+            for (int s = sectionLens[c]; s < sectionLens[c + 1]; s++) maxLen = max(maxLen, timeArray[s * 8 + 7] - timeArray[s * 8]);
+            levelOffset[c + 1] = levelOffset[c] + len;
+            len += maxLen;
+        }
+        levels.resize(levelOffset[numCourses]);
+        if (numCourses) std::fill_n(levels.begin(), 8, 8);
+        last.assign(numCourses, 0);
+        valid = 0;
+    }
+
+    /**
+     * merge the meetings of `sectionIdx` into the blocks `prev`
+     * @returns the length of the merged blocks
+     */
+    int merge(const uint16_t* __restrict__ prev, int sectionIdx, uint16_t* __restrict__ out) const {
+        int bound = 8;
+        const auto* __restrict__ days = timeArray + sectionIdx * 8;
+        for (int d = 0; d < 7; d++) {
+            out[d] = bound;
+            int i = prev[d], j = days[d];
+            const int e1 = prev[d + 1], e2 = days[d + 1];
+            while (i < e1 && j < e2) {
+                const auto* __restrict__ src = timeArrayContent[j] < prev[i] ? timeArrayContent + (j += 3) - 3 : prev + (i += 3) - 3;
+                out[bound] = src[0];
+                out[bound + 1] = src[1];
+                out[bound + 2] = src[2];
+                bound += 3;
+            }
+            memcpy(out + bound, prev + i, (e1 - i) * sizeof(uint16_t));
+            bound += e1 - i;
+            memcpy(out + bound, timeArrayContent + j, (e2 - j) * sizeof(uint16_t));
+            bound += e2 - j;
+        }
+        return out[7] = bound;
+    }
+
+    /**
+     * build the time blocks of `curSchedule` at `curBlock`
+     * @returns the length of the time blocks
+     */
+    int build(const uint16_t* __restrict__ curSchedule, uint16_t* __restrict__ curBlock) {
+        if (numCourses == 0) {
+            std::fill_n(curBlock, 8, 8);
+            return 8;
+        }
+        int same = 0;
+        while (same < valid && last[same] == curSchedule[same]) same++;
+        for (int l = same; l < numCourses - 1; l++) {
+            merge(levels.data() + levelOffset[l], curSchedule[l], levels.data() + levelOffset[l + 1]);
+            last[l] = curSchedule[l];
+        }
+        valid = numCourses - 1;
+        return merge(levels.data() + levelOffset[numCourses - 1], curSchedule[numCourses - 1], curBlock);
+    }
+};
+
+/**
+ * `sort` only orders the first page of `indices`. The other pages are ordered on demand by `orderPage`
+ * when `getSchedule` first accesses them
+ */
+constexpr uint32_t SORT_PAGE_SIZE = 1000;
+/**
+ * the positions p in `indices` such that every schedule before p precedes every schedule from p on, in increasing order.
+ * Contains at least 0 and count after a sort. Empty if `indices` is completely ordered (or needs not be)
+ */
+vector<uint32_t> sortFences;
+/** whether each page of `indices` is ordered. Empty if all of them are (or need not be) */
+vector<bool> sortedPages;
+/** the number of schedules partitioned by `orderPage` since the last sort */
+uint64_t pageSortWork = 0;
+/** whether `indices` holds the order of a previous `sort` of the current schedules */
+bool hasPrevOrder = false;
+
+/**
+ * a key of the last sort: the coefficient array and -1 if the order is reversed, 1 otherwise.
+ * The coefficients are either floats or in the compact form (`qcoeffs` is used if `coeffs` is NULL)
+ */
+struct SortKey {
+    float rev;
+    const float* __restrict__ coeffs;
+    const uint16_t* __restrict__ qcoeffs = NULL;
+
+    float operator[](int i) const {
+        return coeffs != NULL ? coeffs[i] : qcoeffs[i];
+    }
+};
+
+/** @returns the key of the coefficients in cache, reversed if reverse */
+inline SortKey sortKeyOf(const CoeffCache& cache, bool reverse) {
+    return {reverse ? -1.0f : 1.0f, cache.coeffs, cache.qcoeffs};
+}
+/** the keys of the last sort (by priority), used to order the pages and to find the Pareto layers on demand */
+SortKey sortKeys[NUM_SORT_FUNCS];
+int numSortKeys = 0;
+
+/**
+ * call f(cmpFunc) with the comparator given by `sortKeys`. Ties are broken by the index,
+ * so the comparator is a strict total order and the order does not depend on how the pages are sorted
+ */
+template <typename F>
+inline void withSortComparator(F&& f) {
+    if (numSortKeys == 1) {
+        auto withKeys = [&f](const auto* __restrict__ keys) {
+            if (sortKeys[0].rev < 0) {
+                f([keys](int a, int b) { return keys[b] < keys[a] || (keys[b] == keys[a] && a < b); });
+            } else {
+                f([keys](int a, int b) { return keys[a] < keys[b] || (keys[a] == keys[b] && a < b); });
+            }
+        };
+        if (sortKeys[0].coeffs != NULL) {
+            withKeys(sortKeys[0].coeffs);
+        } else {
+            withKeys(sortKeys[0].qcoeffs);
+        }
+        return;
+    }
+    const int n = numSortKeys;
+    f([n](int a, int b) {
+        float r = 0;
+        for (int i = 0; i < n; i++) {
+            // calculate the difference in coefficients
+            r = sortKeys[i].rev * (sortKeys[i][a] - sortKeys[i][b]);
+
+            // if non-zero, returns this coefficient
+            if (r != 0.0) return r < 0;
+
+            // otherwise, fallback to the next sort option
+        }
+        return a < b;
+    });
+}
+
+/**
+ * order the first page (or all, if there are fewer) schedules in `indices` according to cmpFunc.
+ * With more than PARALLEL_EVAL_MIN schedules, each thread partially sorts a chunk of `indices`
+ * and the heads of the chunks are merged. cmpFunc must be a strict total order (ties broken by the index),
+ * so that the result does not depend on the number of threads
+ */
+template <typename F>
+inline void _apply_sort(F cmpFunc) {
+    constexpr uint32_t P = SORT_PAGE_SIZE;
+    sortFences = {0, std::min(P, count), count};
+    sortedPages.assign((count + P - 1) / P, false);
+    if (count) sortedPages[0] = true;
+    pageSortWork = 0;
+    // each chunk has at least one page
+    const int numChunks = count < PARALLEL_EVAL_MIN ? 1 : std::min<uint32_t>(numThreads, count / P);
+    if (numChunks == 1) {
+        if (count > P) {
+            std::partial_sort(indices, indices + P, indices + count, cmpFunc);
+        } else {
+            std::sort(indices, indices + count, cmpFunc);
+        }
+        return;
+    }
+    auto chunkBegin = [&](int t) { return (uint64_t)count * t / numChunks; };
+    parallelFor(numChunks, [&](int t) {
+        std::partial_sort(indices + chunkBegin(t), indices + chunkBegin(t) + P, indices + chunkBegin(t + 1), cmpFunc);
+    });
+    // the first page of all schedules is among the first pages of the chunks
+    vector<int> heads;
+    for (int t = 0; t < numChunks; t++) heads.insert(heads.end(), indices + chunkBegin(t), indices + chunkBegin(t) + P);
+    std::partial_sort(heads.begin(), heads.begin() + P, heads.end(), cmpFunc);
+    // the head of the first chunk is replaced by the first page, and the remaining heads fill the heads of the other chunks
+    std::copy_n(heads.begin(), P, indices);
+    for (int t = 1; t < numChunks; t++) std::copy_n(heads.begin() + t * P, P, indices + chunkBegin(t));
+}
+
+/**
+ * order the first page of `indices` according to cmpFunc like `_apply_sort`, reusing the first page of a previous order.
+ * The previous first page is sorted first. Its last schedule is a threshold: the new first page only holds schedules that
+ * precede it or are on the previous first page, so the other schedules are skipped after one comparison each.
+ * When the order changed little, few schedules precede the threshold and the first page is found in about count comparisons.
+ * Otherwise (e.g. an option was reversed), the first page is sorted from the original order by `_apply_sort`
+ */
+template <typename F>
+inline void repairSort(F cmpFunc) {
+    constexpr uint32_t P = SORT_PAGE_SIZE;
+    if (count <= P) {
+        _apply_sort(cmpFunc);
+        return;
+    }
+    std::sort(indices, indices + P, cmpFunc);
+    const int threshold = indices[P - 1];
+    // the positions after the first page of the schedules that precede the threshold, by chunk
+    const int numChunks = count < PARALLEL_EVAL_MIN ? 1 : numThreads;
+    vector<vector<uint32_t>> found(numChunks);
+    std::atomic<bool> tooMany = false;
+    parallelFor(numChunks, [&](int t) {
+        const uint32_t begin = P + (uint64_t)(count - P) * t / numChunks, end = P + (uint64_t)(count - P) * (t + 1) / numChunks;
+        const uint32_t maxFound = P + (end - begin) / 16;
+        for (uint32_t p = begin; p < end; p++) {
+            if (!cmpFunc(indices[p], threshold)) continue;
+            found[t].push_back(p);
+            if (found[t].size() > maxFound || tooMany.load(std::memory_order_relaxed)) {
+                tooMany = true;
+                return;
+            }
+        }
+    });
+    if (tooMany) {
+        for (uint32_t i = 0; i < count; i++) indices[i] = i;
+        _apply_sort(cmpFunc);
+        return;
+    }
+    vector<int> candidates(indices, indices + P);
+    vector<uint32_t> positions;
+    for (const auto& chunk : found) {
+        for (uint32_t p : chunk) candidates.push_back(indices[p]);
+        positions.insert(positions.end(), chunk.begin(), chunk.end());
+    }
+    std::partial_sort(candidates.begin(), candidates.begin() + P, candidates.end(), cmpFunc);
+    // the schedules pushed out of the first page take the places of those that moved into it
+    std::copy_n(candidates.begin(), P, indices);
+    for (size_t i = 0; i < positions.size(); i++) indices[positions[i]] = candidates[P + i];
+    sortFences = {0, P, count};
+    sortedPages.assign((count + P - 1) / P, false);
+    sortedPages[0] = true;
+    pageSortWork = 0;
+}
+
+/** @returns an unsigned integer with the same order as `val` (-0 and 0 are equal), reversed if rev < 0 */
+inline uint32_t radixKey(float val, float rev) {
+    uint32_t bits = std::bit_cast<uint32_t>(val + 0.0f);
+    // flip all bits of negative numbers and the sign bit of positive numbers
+    bits ^= (uint32_t)((int32_t)bits >> 31) | 0x80000000u;
+    return rev < 0 ? ~bits : bits;
+}
+
+/** @returns `val` of a compact coefficient array, reversed if rev < 0 */
+inline uint32_t radixKey(uint16_t val, float rev) {
+    return rev < 0 ? 0xFFFFu - val : val;
+}
+
+/**
+ * one stable counting sort pass of src into dst by the byte of the elements at `shift`.
+ * Each thread counts and moves the elements of one chunk, in order
+ * @returns false if all elements have the same byte, in which case nothing is moved
+ */
+bool radixPass(const uint64_t* __restrict__ src, uint64_t* __restrict__ dst, int shift) {
+    const int numChunks = count < PARALLEL_EVAL_MIN ? 1 : numThreads;
+    auto chunkBegin = [&](int t) { return (uint64_t)count * t / numChunks; };
+    vector<array<uint32_t, 256>> starts(numChunks);
+    parallelFor(numChunks, [&](int t) {
+        auto& hist = starts[t];
+        hist.fill(0);
+        for (uint64_t i = chunkBegin(t), end = chunkBegin(t + 1); i < end; i++) hist[src[i] >> shift & 255]++;
+    });
+    uint32_t total = 0;
+    for (int d = 0; d < 256; d++) {
+        for (int t = 0; t < numChunks; t++) {
+            const uint32_t n = starts[t][d];
+            if (n == count) return false;
+            starts[t][d] = total;
+            total += n;
+        }
+    }
+    parallelFor(numChunks, [&](int t) {
+        auto& next = starts[t];
+        for (uint64_t i = chunkBegin(t), end = chunkBegin(t + 1); i < end; i++) dst[next[src[i] >> shift & 255]++] = src[i];
+    });
+    return true;
+}
+
+/** complete orders of fewer schedules than this are computed by comparison sorts instead of `radixSort` */
+constexpr uint32_t RADIX_SORT_MIN = 1 << 12;
+
+/**
+ * sort all of `indices` by `keys` (`sortKeys` by default) with a least significant digit radix sort: the schedules
+ * are sorted by each key, from the last one to the first one, with stable byte-wise passes over (key, index) pairs.
+ * The result is the same as sorting with the comparator of `withSortComparator`, in linear time
+ */
+void radixSort(const SortKey* keys = sortKeys, int numKeys = numSortKeys) {
+    vector<uint64_t> pairs(count), temp(count);
+    for (uint32_t i = 0; i < count; i++) pairs[i] = i;
+    const int numChunks = count < PARALLEL_EVAL_MIN ? 1 : numThreads * 4;
+    for (int k = numKeys - 1; k >= 0; k--) {
+        const auto key = keys[k];
+        parallelFor(numChunks, [&](int t) {
+            for (uint64_t i = (uint64_t)count * t / numChunks, end = (uint64_t)count * (t + 1) / numChunks; i < end; i++) {
+                const uint32_t idx = pairs[i];
+                const uint32_t k = key.coeffs != NULL ? radixKey(key.coeffs[idx], key.rev) : radixKey(key.qcoeffs[idx], key.rev);
+                pairs[i] = (uint64_t)k << 32 | idx;
+            }
+        });
+        for (int shift = 32; shift < 64; shift += 8) {
+            if (radixPass(pairs.data(), temp.data(), shift)) pairs.swap(temp);
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) indices[i] = (uint32_t)pairs[i];
+}
+
+/**
+ * order the page-th page of `indices` with the comparator of the last sort.
+ * The segment between the nearest fences around each end of the page is partitioned at that end (quickselect),
+ * then the page is sorted. The fences left behind make later pages cheaper, so that ordering any page costs
+ * O(page size * log(page size)) plus the partitions. A scan of the pages in order partitions all the remaining
+ * schedules for each page, so once the partitions cost about as much as two complete orders,
+ * the rest of `indices` is ordered at once by `radixSort`
+ */
+void orderPage(uint32_t page) {
+    if (count >= RADIX_SORT_MIN && pageSortWork >= 2 * (uint64_t)count) {
+        radixSort();
+        sortFences.clear();
+        sortedPages.clear();
+        return;
+    }
+    const uint32_t begin = page * SORT_PAGE_SIZE, end = std::min(count, begin + SORT_PAGE_SIZE);
+    withSortComparator([&](auto cmpFunc) {
+        for (uint32_t fence : {begin, end}) {
+            auto next = std::upper_bound(sortFences.begin(), sortFences.end(), fence);
+            if (next == sortFences.end() || *(next - 1) == fence) continue;
+            pageSortWork += *next - *(next - 1);
+            std::nth_element(indices + *(next - 1), indices + fence, indices + *next, cmpFunc);
+            sortFences.insert(next, fence);
+        }
+        std::sort(indices + begin, indices + end, cmpFunc);
+    });
+    sortedPages[page] = true;
+}
+
+/**
+ * the positions in `indices` at which the Pareto layers found so far start (SortMode::pareto), followed by the end of the last one.
+ * `indices` holds these layers in order, then the schedules not in a layer yet. Empty if the last sort was in another mode
+ */
+vector<uint32_t> paretoLayers;
+
+/**
+ * write the keys of schedule i for the Pareto layers to key: its coefficients for `sortKeys` (see `radixKey`), the lower the better.
+ * They are read from the cached coefficient arrays, so that the layers take no memory beyond the caches
+ */
+inline void paretoKeysOf(uint32_t i, uint32_t* __restrict__ key) {
+    for (int k = 0; k < numSortKeys; k++) {
+        const auto& sortKey = sortKeys[k];
+        key[k] = sortKey.coeffs != NULL ? radixKey(sortKey.coeffs[i], sortKey.rev) : radixKey(sortKey.qcoeffs[i], sortKey.rev);
+    }
+}
+
+/** the number of keys in a block of `Skyline`, compared at once */
+constexpr int SKYLINE_BLOCK = 16;
+
+/**
+ * the keys of a Pareto layer found so far, none of which can be dominated by a key after them in the order of `sortPareto`.
+ * They are stored in blocks of SKYLINE_BLOCK keys by sort key, so that a block is compared to a key with vector instructions
+ */
+struct Skyline {
+    vector<uint32_t> blocks;
+    uint32_t size = 0;
+    /** the first key added since the sum of the normalized coefficients last changed in the order of `sortPareto` */
+    uint32_t runStart = 0;
+
+    uint32_t& at(uint32_t j, int k) { return blocks[(size_t)(j - j % SKYLINE_BLOCK) * numSortKeys + k * SKYLINE_BLOCK + j % SKYLINE_BLOCK]; }
+
+    /**
+     * filter key by this skyline (sort-filter-skyline)
+     * @returns whether no key of the skyline dominates `key`. If so, `key` is added unless it is already there
+     */
+    bool filter(const uint32_t* __restrict__ key) {
+        const int n = numSortKeys;
+        for (uint32_t w = 0; w < size; w += SKYLINE_BLOCK) {
+            const uint32_t* __restrict__ block = blocks.data() + (size_t)w * n;
+            uint8_t noGreater[SKYLINE_BLOCK], equal[SKYLINE_BLOCK];
+            for (int j = 0; j < SKYLINE_BLOCK; j++) noGreater[j] = equal[j] = 1;
+            for (int k = 0; k < n; k++) {
+                for (int j = 0; j < SKYLINE_BLOCK; j++) {
+                    noGreater[j] &= block[k * SKYLINE_BLOCK + j] <= key[k];
+                    equal[j] &= block[k * SKYLINE_BLOCK + j] == key[k];
+                }
+            }
+            const int end = std::min<uint32_t>(size - w, SKYLINE_BLOCK);
+            bool dominated = false;
+            for (int j = 0; j < end; j++) {
+                if (equal[j]) return true;
+                dominated |= noGreater[j];
+            }
+            if (dominated) return false;
+        }
+        if (size % SKYLINE_BLOCK == 0) blocks.resize(blocks.size() + SKYLINE_BLOCK * n);
+        for (int k = 0; k < n; k++) at(size, k) = key[k];
+        size++;
+        return true;
+    }
+
+    /**
+     * drop the keys added since `runStart` that `key` dominates, which rounding put before it
+     * @returns whether any key was dropped
+     */
+    bool drop(const uint32_t* __restrict__ key) {
+        const int n = numSortKeys;
+        bool dropped = false;
+        for (uint32_t j = runStart; j < size; j++) {
+            bool noLess = true, equal = true;
+            for (int k = 0; k < n; k++) {
+                noLess &= at(j, k) >= key[k];
+                equal &= at(j, k) == key[k];
+            }
+            if (!noLess || equal) continue;
+            // no key is greater, so the dropped keys never dominate or equal another one
+            for (int k = 0; k < n; k++) at(j, k) = UINT32_MAX;
+            dropped = true;
+        }
+        return dropped;
+    }
+};
+
+/**
+ * find the next Pareto layer among the schedules not in a layer yet, which `sortPareto` ordered by the sum
+ * of their normalized coefficients (`coeffs`), then by index. A schedule can only be dominated by those before it,
+ * or by those with the same sum if rounding made them equal. So one scan in that order finds the layer, and its
+ * skyline never holds dominated keys. The layer is moved before the others, and both keep their order
+ */
+void peelLayer() {
+    const int n = numSortKeys;
+    const uint32_t begin = paretoLayers.back();
+    Skyline skyline;
+    vector<int> others;
+    uint32_t out = begin, runOut = begin;
+    uint32_t key[NUM_SORT_FUNCS], last[NUM_SORT_FUNCS], other[NUM_SORT_FUNCS];
+    float sum = 0;
+    bool kept = false;
+    for (uint32_t p = begin; p < count; p++) {
+        const int idx = indices[p];
+        paretoKeysOf(idx, key);
+        if (p == begin || coeffs[idx] != sum) {
+            sum = coeffs[idx];
+            skyline.runStart = skyline.size;
+            runOut = out;
+        } else if (memcmp(key, last, n * sizeof(uint32_t)) == 0) {
+            // many schedules have the same keys, and these have the same sum
+            (kept ? indices[out++] : others.emplace_back()) = idx;
+            continue;
+        }
+        std::copy_n(key, n, last);
+        kept = skyline.filter(key);
+        if (!kept) {
+            others.push_back(idx);
+            continue;
+        }
+        if (skyline.drop(key)) {
+            // move the schedules with the same sum that these keys dominate to the others
+            uint32_t pos = runOut;
+            for (uint32_t r = runOut; r < out; r++) {
+                paretoKeysOf(indices[r], other);
+                if (std::equal(key, key + n, other, std::less_equal<uint32_t>()) && !std::equal(key, key + n, other)) {
+                    others.push_back(indices[r]);
+                } else {
+                    indices[pos++] = indices[r];
+                }
+            }
+            out = pos;
+        }
+        indices[out++] = idx;
+    }
+    std::copy(others.begin(), others.end(), indices + out);
+    paretoLayers.push_back(out);
+}
+
+/** find the Pareto layers until the schedule at position pos of `indices` is in one of them */
+void peelLayers(uint32_t pos) {
+    while (paretoLayers.back() <= pos && paretoLayers.back() < count) peelLayer();
+}
+
+/**
+ * Branch-and-bound search for the best K schedules under the current sort options (GenFlag::topK).
+ *
+ * Keeps a max-heap of the best K schedules found so far, the worst one on top.
+ * For each partial schedule, an admissible lower bound of each bounded sort function
+ * (distance, compactness, lunchTime, noEarly and similarity) is computed from the sections already chosen,
+ * and the subtree is pruned if it cannot beat the K-th best schedule.
+ *
+ * In the combined mode, coefficients are normalized by their range over all valid schedules, as in `sort`.
+ * That range is only known after a full enumeration, so a first pass enumerates the schedules without keeping them
+ * to find it (see `extendRange`), and only the second pass prunes. The memory stays that of K schedules.
+ */
+struct TopKSearch {
+    int K, numCourses;
+    const uint16_t* __restrict__ timeArray;
+    const uint16_t* __restrict__ timeArrayContent;
+    SortOption options[NUM_SORT_FUNCS];
+    int enabled;
+    /** whether schedules are ranked by one combined score. Otherwise, they are ranked lexicographically */
+    bool combined;
+    /** number of keys of each schedule: 1 in the combined mode, `enabled` otherwise */
+    int keyLen;
+    /** range and inverse range of each enabled coefficient over all valid schedules, used by the combined mode */
+    float lo[NUM_SORT_FUNCS], hi[NUM_SORT_FUNCS], ratio[NUM_SORT_FUNCS];
+
+    /** rows, keys and raw coefficients of the schedules in the heap, indexed by slot */
+    vector<uint16_t> rows;
+    vector<float> keys, values;
+    /** the order in which the schedule in each slot was found, used to break ties */
+    vector<uint32_t> seq;
+    /** heap of slots */
+    vector<int> heap;
+    uint32_t numFound;
+
+    /**
+     * remMeetings[l * 7 + d], remMinutes[l * 7 + d]: upper bound of the number of meetings/minutes of class
+     * that the courses from level l onward can add to day d.
+     * remMinDuration[l * 7 + d]: the shortest meeting these courses can add to day d
+     */
+    vector<int> remMeetings, remMinutes, remMinDuration;
+    /**
+     * whether two meetings of a schedule may overlap: meetings of the same section, or of sections of different courses
+     * that do not conflict because their dates are disjoint. Compactness can be negative and a meeting can be placed
+     * between two consecutive classes without fitting in the gap in that case, so compactness and distance are not bounded
+     */
+    bool mayOverlap;
+    /** time blocks of the current (partial) schedule */
+    vector<uint16_t> scratch;
+    /** keys of the schedule being evaluated */
+    float curKey[NUM_SORT_FUNCS], curValues[NUM_SORT_FUNCS];
+
+    void init(int numCourses, int K, const int* __restrict__ sectionLens, const uint16_t* __restrict__ timeArray) {
+        this->numCourses = numCourses;
+        this->K = K;
+        this->timeArray = timeArray;
+        timeArrayContent = timeArray + sectionLens[numCourses] * 8;
+        enabled = getEnabledOptions(options);
+        combined = sortMode == SortMode::combined && enabled > 1;
+        keyLen = combined ? 1 : enabled;
+        std::fill_n(lo, NUM_SORT_FUNCS, std::numeric_limits<float>::infinity());
+        std::fill_n(hi, NUM_SORT_FUNCS, -std::numeric_limits<float>::infinity());
+        std::fill_n(ratio, NUM_SORT_FUNCS, 0.0f);
+        rows.resize(K * numCourses);
+        keys.resize(K * keyLen);
+        values.resize(K * enabled);
+        seq.resize(K);
+        heap.clear();
+        numFound = 0;
+
+        remMeetings.assign((numCourses + 1) * 7, 0);
+        remMinutes.assign((numCourses + 1) * 7, 0);
+        remMinDuration.assign((numCourses + 1) * 7, std::numeric_limits<int>::max());
+        int maxLen = 8;
+        mayOverlap = false;
+        for (int c = numCourses - 1; c >= 0; c--) {
+            int maxTime = 0;
+            for (int d = 0; d < 7; d++) {
+                int meetings = 0, minutes = 0, minDuration = remMinDuration[(c + 1) * 7 + d];
+                for (int sec = sectionLens[c]; sec < sectionLens[c + 1]; sec++) {
+                    int m = 0;
+                    for (int n = timeArray[sec * 8 + d], e = timeArray[sec * 8 + d + 1]; n < e; n += 3) {
+                        int duration = timeArrayContent[n + 1] - timeArrayContent[n];
+                        m += duration;
+                        minDuration = std::min(minDuration, duration);
+                        for (int n2 = n + 3; n2 < e; n2 += 3) {
+                            mayOverlap |= calcOverlap(timeArrayContent[n], timeArrayContent[n + 1],
+                                                       timeArrayContent[n2], timeArrayContent[n2 + 1]) > 0;
+                        }
+                    }
+                    minutes = std::max(minutes, m);
+                    meetings = std::max(meetings, (timeArray[sec * 8 + d + 1] - timeArray[sec * 8 + d]) / 3);
+                }
+                remMeetings[c * 7 + d] = remMeetings[(c + 1) * 7 + d] + meetings;
+                remMinutes[c * 7 + d] = remMinutes[(c + 1) * 7 + d] + minutes;
+                remMinDuration[c * 7 + d] = minDuration;
+            }
+            for (int sec = sectionLens[c]; sec < sectionLens[c + 1]; sec++)
+                maxTime = std::max(maxTime, timeArray[sec * 8 + 7] - timeArray[sec * 8]);
+            maxLen += maxTime;
+        }
+        scratch.resize(maxLen);
+        auto meetAtSameTime = [&](int a, int b) {
+            for (int d = 0; d < 7; d++) {
+                for (int n = timeArray[a * 8 + d], e = timeArray[a * 8 + d + 1]; n < e; n += 3) {
+                    for (int m = timeArray[b * 8 + d], f = timeArray[b * 8 + d + 1]; m < f; m += 3) {
+                        if (calcOverlap(timeArrayContent[n], timeArrayContent[n + 1], timeArrayContent[m], timeArrayContent[m + 1]) > 0)
+                            return true;
+                    }
+                }
+            }
+            return false;
+        };
+        for (int c = 0; c < numCourses && !mayOverlap; c++) {
+            for (int a = sectionLens[c]; a < sectionLens[c + 1] && !mayOverlap; a++) {
+                const auto* __restrict__ conflicts = conflictBits + a * conflictWords;
+                for (int b = sectionLens[c + 1]; b < sectionLens[numCourses] && !mayOverlap; b++)
+                    mayOverlap = !(conflicts[b >> 6] >> (b & 63) & 1) && meetAtSameTime(a, b);
+            }
+        }
+    }
+
+    /** compare the keys of two schedules, breaking ties by the order in which they were found */
+    bool less(const float* a, uint32_t seqA, const float* b, uint32_t seqB) const {
+        for (int i = 0; i < keyLen; i++) {
+            if (a[i] != b[i]) return a[i] < b[i];
+        }
+        return seqA < seqB;
+    }
+
+    bool slotLess(int a, int b) const {
+        return less(&keys[a * keyLen], seq[a], &keys[b * keyLen], seq[b]);
+    }
+
+    /**
+     * the combined score of a normalized coefficient, computed as in `sort`. Bounds below the range are clamped,
+     * which keeps the score non-decreasing in `val`
+     */
+    inline float score(int i, float val) const {
+        float v = options[i].reverse ? (hi[i] - val) * ratio[i] : (val - lo[i]) * ratio[i];
+        v = std::max(v, 0.0f);
+        return options[i].weight * v * v;
+    }
+
+    void computeKey(const float* vals, float* key) const {
+        if (combined) {
+            key[0] = 0;
+            for (int i = 0; i < enabled; i++) key[0] += score(i, vals[i]);
+        } else {
+            for (int i = 0; i < enabled; i++) key[i] = options[i].reverse ? -vals[i] : vals[i];
+        }
+    }
+
+    /** extend the range of the coefficients by a complete schedule, in the first pass of the combined mode */
+    void extendRange(const uint16_t* __restrict__ curSchedule) {
+        buildBlocks(curSchedule, numCourses, scratch.data(), timeArray, timeArrayContent);
+        for (int i = 0; i < enabled; i++) {
+            const float val = sortFunctions[options[i].idx](scratch.data(), curSchedule);
+            lo[i] = std::min(lo[i], val);
+            hi[i] = std::max(hi[i], val);
+        }
+    }
+
+    /** fix the normalization of the combined mode once the range is known */
+    void fixRange() {
+        // as in `sort`, skip the coefficient if all of the values are the same
+        for (int i = 0; i < enabled; i++) ratio[i] = hi[i] > lo[i] ? 1 / (hi[i] - lo[i]) : 0;
+    }
+
+    auto heapCmp() const {
+        return [this](int a, int b) { return slotLess(a, b); };
+    }
+
+    /**
+     * @returns whether the partial schedule `curSchedule[0..level)` cannot beat the K-th best schedule
+     */
+    bool prune(const uint16_t* __restrict__ curSchedule, int level) {
+        if ((int)heap.size() < K) return false;
+        const auto* __restrict__ _blocks = scratch.data();
+        buildBlocks(curSchedule, level, scratch.data(), timeArray, timeArrayContent);
+        const int* __restrict__ meetings = remMeetings.data() + level * 7;
+        const int* __restrict__ minutes = remMinutes.data() + level * 7;
+        const int* __restrict__ minDuration = remMinDuration.data() + level * 7;
+
+        for (int i = 0; i < enabled; i++) {
+            /** -infinity if the coefficient cannot be bounded */
+            float bound = -std::numeric_limits<float>::infinity();
+            switch (options[i].idx) {
+                case 0:  // distance: consecutive classes that no remaining meeting can fit in between
+                    if (timeMatrix == NULL || mayOverlap) break;
+                    bound = 0;
+                    for (int d = 0; d < 7; d++) {
+                        for (int j = _blocks[d], end = _blocks[d + 1] - 5; j < end; j += 3) {
+                            int gap = _blocks[j + 3] - _blocks[j + 1];
+                            if (gap < 45 && gap < minDuration[d]) {
+                                auto r1 = _blocks[j + 2], r2 = _blocks[j + 5];
+                                if (r1 != (uint16_t)65535 && r2 != (uint16_t)65535) bound += timeMatrix[r1 * tmSize + r2];
+                            }
+                        }
+                    }
+                    break;
+                case 2:  // compactness: the span of the day can only grow, minus the class time that may be added
+                    if (mayOverlap) break;
+                    bound = 0;
+                    for (int d = 0; d < 7; d++) {
+                        int start = _blocks[d], end = _blocks[d + 1];
+                        if (end == start) continue;
+                        int gaps = _blocks[end - 2] - _blocks[start] - minutes[d];
+                        for (int j = start; j < end; j += 3) gaps -= _blocks[j + 1] - _blocks[j];
+                        if (gaps > 0) bound += gaps;
+                    }
+                    break;
+                case 3:  // lunchTime: each remaining meeting decreases the overlap of a day by at most 1
+                    bound = 0;
+                    for (int d = 0; d < 7; d++) {
+                        int dayOverlap = -meetings[d];
+                        for (int j = _blocks[d], end = _blocks[d + 1]; j < end; j += 3) {
+                            dayOverlap += calcOverlap(660, 840, (int)_blocks[j], (int)_blocks[j + 1]);
+                        }
+                        if (dayOverlap > 60) bound += dayOverlap;
+                    }
+                    break;
+                case 4:  // noEarly: adding classes can only make the earliest class of a day earlier
+                    bound = noEarly(_blocks, curSchedule);
+                    break;
+                case 5:  // similarity: sections already different from the reference
+                    if (refSchedule == NULL) break;
+                    bound = 0;
+                    for (int j = 0; j < level; j++) bound += refSchedule[j] != curSchedule[j];
+                    break;
+            }
+            // reversed coefficients cannot be bounded from below
+            if (options[i].reverse) bound = -std::numeric_limits<float>::infinity();
+            if (combined) {
+                curValues[i] = bound;
+            } else {
+                curKey[i] = bound;
+            }
+        }
+        if (combined) {
+            curKey[0] = 0;
+            for (int i = 0; i < enabled; i++) {
+                if (curValues[i] != -std::numeric_limits<float>::infinity()) curKey[0] += score(i, curValues[i]);
+            }
+        }
+        // the bound of the subtree only has to be strictly better than the worst, since ties are broken by order
+        const int worst = heap.front();
+        for (int i = 0; i < keyLen; i++) {
+            const float w = keys[worst * keyLen + i];
+            if (curKey[i] != w) return curKey[i] > w;
+        }
+        return true;
+    }
+
+    /** evaluate a complete schedule and keep it if it is among the best K */
+    void add(const uint16_t* __restrict__ curSchedule) {
+        buildBlocks(curSchedule, numCourses, scratch.data(), timeArray, timeArrayContent);
+        for (int i = 0; i < enabled; i++) curValues[i] = sortFunctions[options[i].idx](scratch.data(), curSchedule);
+        const uint32_t curSeq = numFound++;
+
+        int slot;
+        if ((int)heap.size() < K) {
+            slot = heap.size();
+            heap.push_back(slot);
+        } else {
+            computeKey(curValues, curKey);
+            const int worst = heap.front();
+            if (!less(curKey, curSeq, &keys[worst * keyLen], seq[worst])) return;
+            std::pop_heap(heap.begin(), heap.end(), heapCmp());
+            slot = worst;
+        }
+        memcpy(&rows[slot * numCourses], curSchedule, numCourses * sizeof(uint16_t));
+        memcpy(&values[slot * enabled], curValues, enabled * sizeof(float));
+        seq[slot] = curSeq;
+        computeKey(curValues, &keys[slot * keyLen]);
+        if (numFound > (uint32_t)K) {
+            std::push_heap(heap.begin(), heap.end(), heapCmp());
+        } else if (numFound == (uint32_t)K) {
+            // the heap is filled for the first time
+            std::make_heap(heap.begin(), heap.end(), heapCmp());
+        }
+    }
+
+    /**
+     * write the schedules kept, from the best to the worst, to `out`
+     * @returns the number of schedules written
+     */
+    int finish(uint16_t* __restrict__ out) {
+        std::sort(heap.begin(), heap.end(), heapCmp());
+        for (int slot : heap) {
+            memcpy(out, &rows[slot * numCourses], numCourses * sizeof(uint16_t));
+            out += numCourses;
+        }
+        return heap.size();
+    }
+};
+
+/** a + b, saturated at the maximum value of uint64_t */
+inline uint64_t addSat(uint64_t a, uint64_t b) {
+    uint64_t r = a + b;
+    return r < a ? std::numeric_limits<uint64_t>::max() : r;
+}
+
+/** a * b, saturated at the maximum value of uint64_t */
+inline uint64_t mulSat(uint64_t a, uint64_t b) {
+    uint64_t r;
+    return __builtin_mul_overflow(a, b, &r) ? std::numeric_limits<uint64_t>::max() : r;
+}
+
+/**
+ * split the courses into the connected components of the conflict graph, using the packed conflict bitsets.
+ * Two courses are connected if some of their sections conflict
+ * @returns the components ordered by their first course, each with its courses in increasing order
+ */
+vector<vector<int>> findComponents(int numCourses, const int* __restrict__ sectionLens) {
+    // union-find over courses
+    vector<int> parent(numCourses);
+    for (int i = 0; i < numCourses; i++) parent[i] = i;
+    auto find = [&](int i) {
+        while (parent[i] != i) i = parent[i] = parent[parent[i]];
+        return i;
+    };
+    for (int a = 0; a < numCourses; a++) {
+        for (int b = a + 1; b < numCourses; b++) {
+            if (find(a) == find(b)) continue;
+            for (int i = sectionLens[a]; i < sectionLens[a + 1]; i++) {
+                if (findBit(conflictBits + i * conflictWords, sectionLens[b], sectionLens[b + 1]) < sectionLens[b + 1]) {
+                    parent[find(b)] = find(a);
+                    break;
+                }
+            }
+        }
+    }
+    vector<vector<int>> components;
+    vector<int> componentOf(numCourses, -1);
+    for (int i = 0; i < numCourses; i++) {
+        int& c = componentOf[find(i)];
+        if (c < 0) {
+            c = components.size();
+            components.emplace_back();
+        }
+        components[c].push_back(i);
+    }
+    return components;
+}
+
+/**
+ * aggregates of the meetings of each section for each day (section * 7 + day): class time,
+ * overlap with the lunch time (see `lunchTime`) and earliest start (INT_MAX if there is no class).
+ * variance, lunchTime and noEarly only depend on the per day sums or minimums of these over the sections of a schedule,
+ * so they are evaluated without the time blocks
+ */
+vector<int> sectionClassTime, sectionLunchOverlap, sectionEarliest;
+
+/** compute `sectionClassTime`, `sectionLunchOverlap` and `sectionEarliest` */
+void computeSectionStats(int numSections, const uint16_t* __restrict__ timeArray) {
+    const auto* __restrict__ timeArrayContent = timeArray + numSections * 8;
+    sectionClassTime.assign(numSections * 8, 0);
+    sectionLunchOverlap.assign(numSections * 8, 0);
+    sectionEarliest.assign(numSections * 8, std::numeric_limits<int>::max());
+    for (int s = 0; s < numSections; s++) {
+        for (int d = 0; d < 7; d++) {
+            for (int j = timeArray[s * 8 + d], end = timeArray[s * 8 + d + 1]; j < end; j += 3) {
+                sectionClassTime[s * 8 + d] += timeArrayContent[j + 1] - timeArrayContent[j];
+                sectionLunchOverlap[s * 8 + d] += calcOverlap(660, 840, (int)timeArrayContent[j], (int)timeArrayContent[j + 1]);
+                sectionEarliest[s * 8 + d] = std::min<int>(sectionEarliest[s * 8 + d], timeArrayContent[j]);
+            }
+        }
+    }
+}
+
+/**
+ * the schedules of a group of courses that never conflict with the courses of the other groups (GenFlag::factorize).
+ * The schedules of all courses are the Cartesian product of the schedules of the components
+ */
+struct Factor {
+    /** the courses of this component, in increasing order */
+    vector<int> courses;
+    /** the schedules of this component, courses.size() sections each */
+    vector<uint16_t> rows;
+    uint32_t numRows = 0;
+    /** schedule i takes row (i / stride) % numRows of this component */
+    uint64_t stride = 1;
+    /** the aggregates of the sections (see `sectionClassTime`) of each row for each day (row * 7 + day) */
+    vector<int> classTime, lunchOverlap, earliest;
+};
+/**
+ * the components of the current schedules, the last one varying fastest with the schedule index.
+ * Empty if the schedules are stored as full rows in `schedules`
+ */
+vector<Factor> factors;
+/**
+ * copy of the time array and section lengths passed to `generate`, used to build the blocks on demand
+ * when they are not stored (factored schedules or GenFlag::lazyBlocks)
+ */
+vector<uint16_t> evalTimeArray;
+vector<int> evalSectionLens;
+/** number of sections of `evalTimeArray` */
+int evalNumSections = 0;
+
+/**
+ * enumerate the schedules of each component separately (GenFlag::factorize) and store them in `factors`
+ * @param maxRows the maximum number of schedules, also the maximum number of rows of each component
+ * @returns the number of schedules: the product of the number of rows of the components, capped at maxRows
+ */
+uint32_t generateFactors(vector<vector<int>>& components, uint32_t maxRows, const int* __restrict__ sectionLens) {
+    factors.assign(components.size(), {});
+    ForwardChecker checker;
+    for (size_t c = 0; c < components.size(); c++) {
+        auto& f = factors[c];
+        f.courses = std::move(components[c]);
+        const int len = f.courses.size();
+        checker.init(len, sectionLens, genFlags, f.courses.data());
+        while (f.numRows < maxRows && checker.next()) {
+            for (int course : f.courses) f.rows.push_back(checker.row[course]);
+            f.numRows++;
+        }
+
+        f.classTime.assign(f.numRows * 7, 0);
+        f.lunchOverlap.assign(f.numRows * 7, 0);
+        f.earliest.assign(f.numRows * 7, std::numeric_limits<int>::max());
+        for (uint32_t r = 0; r < f.numRows; r++) {
+            for (int k = 0; k < len; k++) {
+                const int sec = f.rows[r * len + k];
+                for (int d = 0; d < 7; d++) {
+                    f.classTime[r * 7 + d] += sectionClassTime[sec * 8 + d];
+                    f.lunchOverlap[r * 7 + d] += sectionLunchOverlap[sec * 8 + d];
+                    f.earliest[r * 7 + d] = std::min(f.earliest[r * 7 + d], sectionEarliest[sec * 8 + d]);
+                }
+            }
+        }
+    }
+    uint64_t total = 1;
+    for (int c = factors.size() - 1; c >= 0; c--) {
+        factors[c].stride = total;
+        total = mulSat(total, factors[c].numRows);
+    }
+    return std::min<uint64_t>(total, maxRows);
+}
+
+/** write the sections of the factored schedule i to `out`, in course order */
+inline void decodeSchedule(uint64_t i, uint16_t* __restrict__ out) {
+    for (const auto& f : factors) {
+        const int len = f.courses.size();
+        const auto* __restrict__ row = f.rows.data() + (i / f.stride % f.numRows) * len;
+        for (int k = 0; k < len; k++) out[f.courses[k]] = row[k];
+    }
+}
+
+/**
+ * @returns the sections of schedule i (in generation order), decoded into `scratch` if the schedules are factored or packed
+ */
+inline const uint16_t* rowOf(uint32_t i, uint16_t* __restrict__ scratch) {
+    if (packed) {
+        unpackRow(i, scratch);
+        return scratch;
+    }
+    if (factors.empty()) return schedules + i * numCourses;
+    decodeSchedule(i, scratch);
+    return scratch;
+}
+
+/**
+ * compute the time blocks of schedules [begin, end) into `blocks`, starting at `blocks + offset`,
+ * and record the offset of each of them
+ * @param timeArrayContent the content of the time array, sorted by `sortTimeArrayContent`
+ */
+void addToEvalRange(const uint16_t* __restrict__ timeArray, const uint16_t* __restrict__ timeArrayContent,
+                    const int* __restrict__ sectionLens, uint32_t begin, uint32_t end, int offset) {
+    BlockMerger merger;
+    merger.init(numCourses, sectionLens, timeArray, timeArrayContent);
+    vector<uint16_t> row(numCourses);
+    for (uint32_t i = begin; i < end; i++) {  // for each schedule
+        // record the current offset
+        offsets[i] = offset;
+        offset += merger.build(rowOf(i, row.data()), blocks + offset);
+    }
+}
+
+/** number of schedules after substituting the members of the classes (GenFlag::collapse) */
+uint64_t expandedCount = 0;
+/**
+ * expandPrefix[p]: the number of schedules, after the substitution, before the p-th sorted schedule.
+ * Cleared whenever the order changes and rebuilt by `getSchedule`
+ */
+vector<uint64_t> expandPrefix;
+
+/** @returns the number of schedules obtained by substituting the members of the classes into `row` */
+inline uint64_t numExpansions(const uint16_t* __restrict__ row) {
+    uint64_t n = 1;
+    for (int c = 0; c < numCourses; c++) n = mulSat(n, classSize[row[c]]);
+    return n;
+}
+
+/**
+ * replace the representatives in `row` by the e-th combination of the members of their classes, the last course varying fastest.
+ * The section of the reference schedule comes first in its class, so the first combination is the most similar one
+ */
+inline void expandSchedule(uint64_t e, uint16_t* __restrict__ row) {
+    for (int c = numCourses - 1; c >= 0; c--) {
+        const int size = classSize[row[c]];
+        const auto* __restrict__ members = classMembers.data() + classBegin[row[c]];
+        int d = e % size;
+        e /= size;
+        if (refSchedule != NULL) {
+            const int refPos = std::find(members, members + size, refSchedule[c]) - members;
+            if (refPos < size) d = d == 0 ? refPos : d - (d <= refPos);
+        }
+        row[c] = members[d];
+    }
+}
+
+/**
+ * call f(i, digits) for each factored schedule i in [begin, end), where digits[c] is the row of component c used by schedule i
+ */
+template <typename F>
+inline void forEachFactored(uint32_t begin, uint32_t end, F&& f) {
+    const int numFactors = factors.size();
+    vector<uint32_t> digits(numFactors);
+    for (int c = 0; c < numFactors && begin < end; c++) digits[c] = begin / factors[c].stride % factors[c].numRows;
+    for (uint32_t i = begin; i < end; i++) {
+        f(i, digits.data());
+        for (int c = numFactors - 1; c >= 0 && ++digits[c] == factors[c].numRows; c--) digits[c] = 0;
+    }
+}
+
+/**
+ * evaluate the sort function funcIdx on the factored schedules [begin, end) and store the results in `out`.
+ * variance, lunchTime and noEarly only depend on per day sums or minimums, and similarity on per course matches,
+ * so they are combined from the aggregates of the components. The other functions build the blocks
+ * of each schedule in a scratch buffer. Results are the same as evaluating the fully built blocks
+ */
+void computeFactoredCoeffs(int funcIdx, float* __restrict__ out, uint32_t begin, uint32_t end) {
+    switch (funcIdx) {
+        case 1:  // variance
+            forEachFactored(begin, end, [&](uint32_t i, const uint32_t* digits) {
+                int classTime[7] = {0};
+                for (size_t c = 0; c < factors.size(); c++) {
+                    const auto* __restrict__ rowTime = factors[c].classTime.data() + digits[c] * 7;
+                    for (int d = 0; d < 7; d++) classTime[d] += rowTime[d];
+                }
+                out[i] = varianceOf(classTime);
+            });
+            return;
+        case 3:  // lunchTime
+            forEachFactored(begin, end, [&](uint32_t i, const uint32_t* digits) {
+                int dayOverlap[7] = {0};
+                for (size_t c = 0; c < factors.size(); c++) {
+                    const auto* __restrict__ rowOverlap = factors[c].lunchOverlap.data() + digits[c] * 7;
+                    for (int d = 0; d < 7; d++) dayOverlap[d] += rowOverlap[d];
+                }
+                out[i] = lunchTimeOf(dayOverlap);
+            });
+            return;
+        case 4:  // noEarly
+            forEachFactored(begin, end, [&](uint32_t i, const uint32_t* digits) {
+                int earliest[7];
+                std::fill_n(earliest, 7, std::numeric_limits<int>::max());
+                for (size_t c = 0; c < factors.size(); c++) {
+                    const auto* __restrict__ rowEarliest = factors[c].earliest.data() + digits[c] * 7;
+                    for (int d = 0; d < 7; d++) earliest[d] = std::min(earliest[d], rowEarliest[d]);
+                }
+                out[i] = noEarlyOf(earliest);
+            });
+            return;
+        case 5: {  // similarity
+            vector<vector<int>> matches(factors.size());
+            for (size_t c = 0; c < factors.size(); c++) {
+                const auto& f = factors[c];
+                const int len = f.courses.size();
+                matches[c].assign(f.numRows, 0);
+                for (uint32_t r = 0; r < f.numRows; r++) {
+                    for (int k = 0; k < len; k++) matches[c][r] += refSchedule[f.courses[k]] == f.rows[r * len + k];
+                }
+            }
+            forEachFactored(begin, end, [&](uint32_t i, const uint32_t* digits) {
+                int sum = numCourses;
+                for (size_t c = 0; c < factors.size(); c++) sum -= matches[c][digits[c]];
+                out[i] = sum;
+            });
+            return;
+        }
+    }
+    const auto* __restrict__ timeArrayContent = evalTimeArray.data() + evalNumSections * 8;
+    vector<uint16_t> row(numCourses), scratch(evalTimeArray.size() + 8);
+    auto evalFunc = sortFunctions[funcIdx];
+    forEachFactored(begin, end, [&](uint32_t i, const uint32_t* digits) {
+        for (size_t c = 0; c < factors.size(); c++) {
+            const auto& f = factors[c];
+            const int len = f.courses.size();
+            for (int k = 0; k < len; k++) row[f.courses[k]] = f.rows[digits[c] * len + k];
+        }
+        buildBlocks(row.data(), numCourses, scratch.data(), evalTimeArray.data(), timeArrayContent);
+        out[i] = evalFunc(scratch.data(), row.data());
+    });
+}
+
+/** number of sort functions evaluated by `computeRowCoeffs`: all of them except IamFeelingLucky */
+constexpr int NUM_KERNEL_FUNCS = 6;
+
+#ifdef USE_SIMD
+/**
+ * vectors of 8 int32 or float, used for the 8 (padded) days of a schedule or for 8 schedules.
+ * These are generic vectors: they compile to SSE or AVX2 on native builds and to SIMD128 on the web build (-msimd128)
+ */
+typedef int vint8 __attribute__((vector_size(32)));
+typedef float vfloat8 __attribute__((vector_size(32)));
+/** number of schedules evaluated together by the vectorized part of `computeRowCoeffs` */
+constexpr int SIMD_LANES = 8;
+
+/** load a vector from unaligned memory */
+template <typename V, typename T>
+inline void loadVec(V& v, const T* __restrict__ p) {
+    memcpy(&v, p, sizeof(V));
+}
+#endif
+
+/**
+ * evaluate the sort functions in Mask (bit i for sortFunctions[i]) on the schedules [begin, end) stored as rows
+ * in a single pass over the schedules, and store the results in the arrays of `caches` and their range in `caches`.
+ * variance, lunchTime and noEarly are combined from the aggregates of the sections (see `sectionClassTime`).
+ * distance and compactness use the time blocks, which are built in a scratch buffer if they are not stored (GenFlag::lazyBlocks).
+ * Results are the same as evaluating the stored blocks with `sortFunctions`.
+ *
+ * With USE_SIMD, the aggregates of a schedule are summed with one vector operation per course, and the aggregates of
+ * SIMD_LANES schedules are transposed so that variance, lunchTime and noEarly are computed for all of them at once.
+ * The operations on each lane are the same as the scalar ones, so the results are identical
+ * @param timeArrayContent the content of `evalTimeArray` sorted by `sortTimeArrayContent`, used if the blocks are not stored
+ * @note the coefficient arrays of the functions in Mask must be allocated
+ */
+template <int Mask>
+void computeRowCoeffs(CoeffCache* __restrict__ caches, uint32_t begin, uint32_t end, const uint16_t* __restrict__ timeArrayContent) {
+    constexpr bool needBlocks = Mask & 0b101, needEarliest = Mask & 0b10000;
+    vector<uint16_t> row(numCourses), scratch;
+    BlockMerger merger;
+    if (needBlocks && blocks == NULL) {
+        merger.init(numCourses, evalSectionLens.data(), evalTimeArray.data(), timeArrayContent);
+        scratch.resize(evalTimeArray.size() + 8);
+    }
+    float* __restrict__ out[NUM_KERNEL_FUNCS];
+    float max[NUM_KERNEL_FUNCS], min[NUM_KERNEL_FUNCS];
+    for (int f = 0; f < NUM_KERNEL_FUNCS; f++) {
+        out[f] = caches[f].coeffs;
+        max[f] = -std::numeric_limits<float>::infinity();
+        min[f] = std::numeric_limits<float>::infinity();
+    }
+    auto record = [&](int f, uint32_t i, float val) {
+        out[f][i] = val;
+        if (val > max[f]) max[f] = val;
+        if (val < min[f]) min[f] = val;
+    };
+#ifdef USE_SIMD
+    // the aggregates of the current batch of schedules, soaX[d * SIMD_LANES + l] for day d of the l-th schedule
+    alignas(32) int soaTime[8 * SIMD_LANES], soaOverlap[8 * SIMD_LANES], soaEarliest[8 * SIMD_LANES];
+    vfloat8 vmax[NUM_KERNEL_FUNCS], vmin[NUM_KERNEL_FUNCS];
+    for (int f = 0; f < NUM_KERNEL_FUNCS; f++) {
+        vmax[f] = vfloat8{} + max[f];
+        vmin[f] = vfloat8{} + min[f];
+    }
+    // evaluate the n schedules of the batch starting at `first`
+    auto evalBatch = [&](uint32_t first, int n) {
+        // fill the unused lanes with the first schedule, so that they do not change the range
+        for (int l = n; l < SIMD_LANES; l++) {
+            for (int d = 0; d < 8; d++) {
+                soaTime[d * SIMD_LANES + l] = soaTime[d * SIMD_LANES];
+                soaOverlap[d * SIMD_LANES + l] = soaOverlap[d * SIMD_LANES];
+                soaEarliest[d * SIMD_LANES + l] = soaEarliest[d * SIMD_LANES];
+            }
+        }
+        auto store = [&](int f, vfloat8 val) {
+            memcpy(out[f] + first, &val, n * sizeof(float));
+            vmax[f] = val > vmax[f] ? val : vmax[f];
+            vmin[f] = val < vmin[f] ? val : vmin[f];
+        };
+        if constexpr (Mask & 0b10) {  // variance
+            vint8 sum = {}, sumSq = {};
+            for (int d = 0; d < 7; d++) {
+                vint8 classTime;
+                loadVec(classTime, soaTime + d * SIMD_LANES);
+                sum += classTime;
+                sumSq += classTime * classTime;
+            }
+            vfloat8 mean = __builtin_convertvector(sum, vfloat8) / 5.0f;
+            store(1, __builtin_convertvector(sumSq, vfloat8) / 5.0f - mean * mean);
+        }
+        if constexpr (Mask & 0b1000) {  // lunchTime
+            vint8 totalOverlap = {};
+            for (int d = 0; d < 7; d++) {
+                vint8 dayOverlap;
+                loadVec(dayOverlap, soaOverlap + d * SIMD_LANES);
+                totalOverlap += dayOverlap > 60 ? dayOverlap : vint8{};
+            }
+            store(3, __builtin_convertvector(totalOverlap, vfloat8));
+        }
+        if constexpr (Mask & 0b10000) {  // noEarly. An empty day (INT_MAX) gives a negative difference, which is cut to 0
+            vint8 total = {};
+            for (int d = 0; d < 7; d++) {
+                vint8 temp;
+                loadVec(temp, soaEarliest + d * SIMD_LANES);
+                temp = 12 * 60 - temp;
+                temp = temp > 0 ? temp : vint8{};
+                total += temp * temp;
+            }
+            store(4, __builtin_convertvector(total, vfloat8));
+        }
+    };
+#endif
+    for (uint32_t i = begin; i < end; i++) {
+        const auto* __restrict__ r = rowOf(i, row.data());
+        const uint16_t* __restrict__ _blocks = NULL;
+        if constexpr (needBlocks) {
+            if (blocks != NULL) {
+                _blocks = blocks + offsets[i];
+            } else {
+                merger.build(r, scratch.data());
+                _blocks = scratch.data();
+            }
+        }
+        if constexpr (Mask & 0b1) record(0, i, distance(_blocks, r));
+        if constexpr (Mask & 0b100) record(2, i, compactness(_blocks, r));
+        if constexpr (Mask & 0b100000) record(5, i, similarity(_blocks, r));
+        if constexpr (!(Mask & 0b11010)) continue;
+#ifdef USE_SIMD
+        vint8 classTime = {}, dayOverlap = {}, earliest = vint8{} + std::numeric_limits<int>::max(), v;
+        for (int c = 0; c < numCourses; c++) {
+            const int sec = r[c] * 8;
+            if constexpr (Mask & 0b10) {
+                loadVec(v, sectionClassTime.data() + sec);
+                classTime += v;
+            }
+            if constexpr (Mask & 0b1000) {
+                loadVec(v, sectionLunchOverlap.data() + sec);
+                dayOverlap += v;
+            }
+            if constexpr (needEarliest) {
+                loadVec(v, sectionEarliest.data() + sec);
+                earliest = v < earliest ? v : earliest;
+            }
+        }
+        const int lane = (i - begin) % SIMD_LANES;
+        for (int d = 0; d < 8; d++) {
+            soaTime[d * SIMD_LANES + lane] = classTime[d];
+            soaOverlap[d * SIMD_LANES + lane] = dayOverlap[d];
+            soaEarliest[d * SIMD_LANES + lane] = earliest[d];
+        }
+        if (lane == SIMD_LANES - 1 || i == end - 1) evalBatch(i - lane, lane + 1);
+#else
+        // the days are padded to 8 so that the loops over them can be vectorized
+        int classTime[8] = {0}, dayOverlap[8] = {0}, earliest[8];
+        if constexpr (needEarliest) std::fill_n(earliest, 8, std::numeric_limits<int>::max());
+        for (int c = 0; c < numCourses; c++) {
+            const int sec = r[c] * 8;
+            if constexpr (Mask & 0b10) {
+                for (int d = 0; d < 8; d++) classTime[d] += sectionClassTime[sec + d];
+            }
+            if constexpr (Mask & 0b1000) {
+                for (int d = 0; d < 8; d++) dayOverlap[d] += sectionLunchOverlap[sec + d];
+            }
+            if constexpr (needEarliest) {
+                for (int d = 0; d < 8; d++) earliest[d] = std::min(earliest[d], sectionEarliest[sec + d]);
+            }
+        }
+        if constexpr (Mask & 0b10) record(1, i, varianceOf(classTime));
+        if constexpr (Mask & 0b1000) record(3, i, lunchTimeOf(dayOverlap));
+        if constexpr (Mask & 0b10000) record(4, i, noEarlyOf(earliest));
+#endif
+    }
+#ifdef USE_SIMD
+    for (int f = 0; f < NUM_KERNEL_FUNCS; f++) {
+        for (int l = 0; l < SIMD_LANES; l++) {
+            max[f] = std::max(max[f], vmax[f][l]);
+            min[f] = std::min(min[f], vmin[f][l]);
+        }
+    }
+#endif
+    for (int f = 0; f < NUM_KERNEL_FUNCS; f++) {
+        if (!(Mask >> f & 1)) continue;
+        caches[f].max = max[f];
+        caches[f].min = min[f];
+    }
+}
+
+template <size_t... Masks>
+constexpr array<void (*)(CoeffCache*, uint32_t, uint32_t, const uint16_t*), sizeof...(Masks)> makeRowCoeffKernels(index_sequence<Masks...>) {
+    return {computeRowCoeffs<Masks>...};
+}
+/** rowCoeffKernels[mask]: `computeRowCoeffs` specialized for each subset of the sort functions */
+constexpr auto rowCoeffKernels = makeRowCoeffKernels(make_index_sequence<1 << NUM_KERNEL_FUNCS>());
+
+/**
+ * Counts the valid schedules without enumerating them, using the packed conflict bitsets.
+ *
+ * Courses are first split into independent components: two courses are in the same component
+ * if some of their sections conflict. The count is the product of the counts of the components.
+ * Each component is counted by a DFS with forward checking, memoized on the bitset of sections
+ * still allowed for the courses not yet assigned: subtrees that leave the same sections available
+ * have the same number of completions.
+ * @note counting is #P-hard in general. The memo makes it fast when sections share meeting times,
+ * as real catalogs do, but adversarial inputs can still take exponential time
+ */
+struct ScheduleCounter {
+    int numCourses;
+    const int* __restrict__ sectionLens;
+    /** courses of the component being counted, in increasing order */
+    vector<int> courses;
+    /** allowed[l * conflictWords + w]: the allowed sections after assigning the first l courses of the component */
+    vector<uint64_t> allowed;
+    /** memo of the number of completions, keyed by level and the relevant part of the allowed bitset */
+    HashMap<string, uint64_t> memo;
+    /** stop memoizing when the memo grows larger than this */
+    static constexpr uint32_t MAX_MEMO_SIZE = 1 << 20;
+
+    /** @param allowedSections if not empty, only these sections (as a bitset) are counted */
+    uint64_t count(int numCourses, const int* __restrict__ sectionLens, const vector<uint64_t>& allowedSections = {}) {
+        this->numCourses = numCourses;
+        this->sectionLens = sectionLens;
+        uint64_t total = 1;
+        for (auto& component : findComponents(numCourses, sectionLens)) {
+            if (!total) break;
+            courses = std::move(component);
+            allowed.assign((courses.size() + 1) * conflictWords, ~0ULL);
+            for (int w = 0; w < (int)allowedSections.size(); w++) allowed[w] &= allowedSections[w];
+            memo.clear();
+            total = mulSat(total, countFrom(0));
+        }
+        memo.clear();
+        return total;
+    }
+
+    /** number of ways to complete the component given the allowed sections at `level` */
+    uint64_t countFrom(int level) {
+        const int n = courses.size();
+        const int course = courses[level];
+        const auto* __restrict__ cur = allowed.data() + level * conflictWords;
+        const int begin = sectionLens[course], end = sectionLens[course + 1];
+        // the last course: every allowed section completes a schedule
+        if (level + 1 == n) return countBits(cur, begin, end);
+        // the last two courses: count the compatible pairs directly
+        if (level + 2 == n) {
+            const int last = courses[level + 1];
+            const int lastBegin = sectionLens[last], lastEnd = sectionLens[last + 1];
+            const int firstWord = lastBegin >> 6, lastWord = (lastEnd - 1) >> 6;
+            const uint64_t firstMask = ~0ULL << (lastBegin & 63), lastMask = ~0ULL >> (63 - ((lastEnd - 1) & 63));
+            uint64_t total = 0;
+            for (int i = findBit(cur, begin, end); i < end; i = findBit(cur, i + 1, end)) {
+                const auto* __restrict__ conflict = conflictBits + i * conflictWords;
+                for (int w = firstWord; w <= lastWord; w++) {
+                    uint64_t word = cur[w] & ~conflict[w];
+                    if (w == firstWord) word &= firstMask;
+                    if (w == lastWord) word &= lastMask;
+                    total += std::popcount(word);
+                }
+            }
+            return total;
+        }
+
+        // only the sections from this course onward matter for the completions
+        const int firstWord = begin >> 6;
+        const uint64_t first = cur[firstWord] & (~0ULL << (begin & 63));
+        string key(sizeof(int) + (conflictWords - firstWord) * sizeof(uint64_t), '\0');
+        memcpy(key.data(), &level, sizeof(int));
+        memcpy(key.data() + sizeof(int), &first, sizeof(uint64_t));
+        memcpy(key.data() + sizeof(int) + sizeof(uint64_t), cur + firstWord + 1,
+               (conflictWords - firstWord - 1) * sizeof(uint64_t));
+        auto it = memo.find(key);
+        if (it != memo.end()) return it->second;
+
+        uint64_t total = 0;
+        auto* __restrict__ nextAllowed = allowed.data() + (level + 1) * conflictWords;
+        for (int i = findBit(cur, begin, end); i < end; i = findBit(cur, i + 1, end)) {
+            const auto* __restrict__ conflict = conflictBits + i * conflictWords;
+            for (int w = end >> 6; w < conflictWords; w++) nextAllowed[w] = cur[w] & ~conflict[w];
+            bool dead = false;
+            for (int l = level + 1; l < n && !dead; l++) {
+                const int c = courses[l];
+                dead = findBit(nextAllowed, sectionLens[c], sectionLens[c + 1]) == sectionLens[c + 1];
+            }
+            if (!dead) total = addSat(total, countFrom(level + 1));
+        }
+        if (memo.size() < MAX_MEMO_SIZE) memo.emplace(std::move(key), total);
+        return total;
+    }
+
+    /**
+     * count the schedules of all courses as a single component, keeping the memo for `unrank`.
+     * Only the sections allowed by the constraints on single sections are counted
+     */
+    uint64_t countAll(int numCourses, const int* __restrict__ sectionLens) {
+        this->numCourses = numCourses;
+        this->sectionLens = sectionLens;
+        courses.resize(numCourses);
+        for (int c = 0; c < numCourses; c++) courses[c] = c;
+        allowed.assign((numCourses + 1) * conflictWords, ~0ULL);
+        for (int w = 0; w < (int)constraints.allowedSections.size(); w++) allowed[w] &= constraints.allowedSections[w];
+        memo.clear();
+        for (int c = 0; c < numCourses; c++) {
+            if (findBit(allowed.data(), sectionLens[c], sectionLens[c + 1]) == sectionLens[c + 1]) return 0;
+        }
+        return countFrom(0);
+    }
+
+    /**
+     * decode the schedule at `rank` in the order of `generate` after `countAll`: at each level, skip the sections
+     * whose numbers of completions add up to at most the rank left
+     * @param rank less than the count
+     */
+    void unrank(uint64_t rank, uint16_t* __restrict__ row) {
+        const int n = courses.size();
+        for (int level = 0; level < n; level++) {
+            const auto* __restrict__ cur = allowed.data() + level * conflictWords;
+            auto* __restrict__ nextAllowed = allowed.data() + (level + 1) * conflictWords;
+            const int begin = sectionLens[level], end = sectionLens[level + 1];
+            for (int i = findBit(cur, begin, end); i < end; i = findBit(cur, i + 1, end)) {
+                uint64_t completions = 1;
+                if (level + 1 < n) {
+                    // same as in countFrom
+                    const auto* __restrict__ conflict = conflictBits + i * conflictWords;
+                    for (int w = end >> 6; w < conflictWords; w++) nextAllowed[w] = cur[w] & ~conflict[w];
+                    bool dead = false;
+                    for (int l = level + 1; l < n && !dead; l++)
+                        dead = findBit(nextAllowed, sectionLens[l], sectionLens[l + 1]) == sectionLens[l + 1];
+                    completions = dead ? 0 : countFrom(level + 1);
+                }
+                if (rank < completions) {
+                    row[level] = i;
+                    break;
+                }
+                rank -= completions;
+            }
+        }
+    }
+};
+
+/**
+ * enumerate all schedules satisfying the constraints and keep maxRows of them uniformly at random in `schedules`
+ * (reservoir sampling), for when the constraints reject too many draws of `sampleSchedules`.
+ * The kept schedules are stored in the order of `generate`
+ * @returns the number of schedules kept
+ */
+int reservoirSample(int numCourses, uint32_t maxRows, const int* __restrict__ sectionLens, std::mt19937_64& eng) {
+    static ForwardChecker checker;
+    checker.init(numCourses, sectionLens);
+    const auto* row = checker.row.data();
+    // found[r]: the position in the order of `generate` of the schedule kept at row r
+    vector<uint64_t> found;
+    uint64_t numFound = 0;
+    while (checker.next([&](int level) { return constraints.active && !constraints.push(level - 1, row[level - 1]); })) {
+        if (constraints.active && !constraints.accepts(row, numCourses)) continue;
+        uint64_t r = numFound++;
+        if (r >= maxRows) {
+            r = std::uniform_int_distribution<uint64_t>(0, r)(eng);
+            if (r >= maxRows) continue;
+        } else {
+            found.push_back(0);
+        }
+        found[r] = numFound - 1;
+        std::copy_n(row, numCourses, schedules + r * numCourses);
+    }
+    vector<uint32_t> order(found.size());
+    for (uint32_t r = 0; r < order.size(); r++) order[r] = r;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return found[a] < found[b]; });
+    vector<uint16_t> rows(schedules, schedules + found.size() * numCourses);
+    for (uint32_t r = 0; r < order.size(); r++) std::copy_n(rows.data() + order[r] * numCourses, numCourses, schedules + r * numCourses);
+    return found.size();
+}
+
+/**
+ * draw maxRows distinct schedules uniformly at random into `schedules` (see GenFlag::sample).
+ * Ranks are drawn until enough of them decode to schedules satisfying the constraints on schedules.
+ * Only the accepted ranks are remembered, so the memory is that of maxRows schedules. If the constraints reject
+ * most draws, the draws are given up after a number of them proportional to maxRows, and `reservoirSample` is used instead
+ * @returns the number of schedules drawn, or -1 if there are at most maxRows schedules, so that all of them
+ * should be generated by the search instead
+ */
+int sampleSchedules(int numCourses, uint32_t maxRows, const int* __restrict__ sectionLens) {
+    if (numCourses == 0) return -1;
+    static ScheduleCounter counter;
+    const uint64_t total = counter.countAll(numCourses, sectionLens);
+    if (total <= maxRows) return -1;
+    std::mt19937_64 eng(randomSeed);
+    std::uniform_int_distribution<uint64_t> dist(0, total - 1);
+    HashSet<uint64_t> drawn;
+    vector<uint16_t> row(numCourses);
+    const uint64_t maxDraws = 64 * (uint64_t)maxRows + 1024;
+    for (uint64_t draws = 0; drawn.size() < maxRows && draws < maxDraws; draws++) {
+        const uint64_t rank = dist(eng);
+        if (drawn.count(rank)) continue;
+        if (constraints.active) {
+            counter.unrank(rank, row.data());
+            if (!constraints.accepts(row.data(), numCourses)) continue;
+        }
+        drawn.insert(rank);
+    }
+    if (drawn.size() < maxRows) {
+        counter.memo.clear();
+        return reservoirSample(numCourses, maxRows, sectionLens, eng);
+    }
+    vector<uint64_t> ranks(drawn.begin(), drawn.end());
+    std::sort(ranks.begin(), ranks.end());
+    for (uint32_t r = 0; r < ranks.size(); r++) counter.unrank(ranks[r], schedules + r * numCourses);
+    counter.memo.clear();
+    return ranks.size();
+}
+
+/**
+ * evaluate the sort functions in `mask` (bit i for sortFunctions[i]) on the schedules from `first` on into the
+ * coefficient arrays of their caches and record their ranges. The schedules stored as rows are evaluated
+ * for all of them in a single pass (see `computeRowCoeffs`)
+ * @param first if not 0, the coefficients of the schedules before it are kept and the ranges are extended
+ */
+void evaluateCoeffs(int mask, uint32_t first = 0) {
+    // IamFeelingLucky is only a place holder
+    if (mask >> 6 & 1) {
+        auto& cache = sortCoeffCache[6];
+        std::fill_n(cache.coeffs + first, count - first, 1.0f);
+        cache.max = cache.min = 1.0f;
+    }
+    mask &= (1 << NUM_KERNEL_FUNCS) - 1;
+
+    // the schedules are split into chunks evaluated in parallel, each with its own range
+    const uint32_t n = count - first;
+    const int numChunks = n < PARALLEL_EVAL_MIN ? 1 : numThreads * 4;
+    vector<array<CoeffCache, NUM_SORT_FUNCS>> chunkCaches(numChunks);
+    const auto* timeArrayContent = blocks == NULL && factors.empty() && !evalTimeArray.empty()
+                                       ? sortTimeArrayContent(evalTimeArray.data(), evalNumSections) : NULL;
+    parallelFor(numChunks, [&](int t) {
+        const uint32_t begin = first + (uint64_t)n * t / numChunks, end = first + (uint64_t)n * (t + 1) / numChunks;
+        auto* caches = chunkCaches[t].data();
+        std::copy_n(sortCoeffCache, NUM_SORT_FUNCS, caches);
+        if (factors.empty()) {
+            rowCoeffKernels[mask](caches, begin, end, timeArrayContent);
+            return;
+        }
+        for (int f = 0; f < NUM_KERNEL_FUNCS; f++) {
+            if (!(mask >> f & 1)) continue;
+            auto& cache = caches[f];
+            computeFactoredCoeffs(f, cache.coeffs, begin, end);
+            cache.max = -std::numeric_limits<float>::infinity();
+            cache.min = std::numeric_limits<float>::infinity();
+            for (uint32_t i = begin; i < end; i++) {
+                if (cache.coeffs[i] > cache.max) cache.max = cache.coeffs[i];
+                if (cache.coeffs[i] < cache.min) cache.min = cache.coeffs[i];
+            }
+        }
+    });
+    for (int f = 0; f < NUM_KERNEL_FUNCS; f++) {
+        if (!(mask >> f & 1)) continue;
+        auto& cache = sortCoeffCache[f];
+        if (first == 0) {
+            cache.max = -std::numeric_limits<float>::infinity();
+            cache.min = std::numeric_limits<float>::infinity();
+        }
+        for (const auto& caches : chunkCaches) {
+            cache.max = std::max(cache.max, caches[f].max);
+            cache.min = std::min(cache.min, caches[f].min);
+        }
+    }
+}
+
+/** store the float coefficients of cache in the compact form (see `CoeffCache::qcoeffs`) */
+void quantizeCoeffs(CoeffCache& cache) {
+    cache.qcoeffs = new uint16_t[count];
+    const float range = cache.max - cache.min;
+    const float scale = range > 0 ? 65535 / range : 0;
+    const int numChunks = count < PARALLEL_EVAL_MIN ? 1 : numThreads * 4;
+    parallelFor(numChunks, [&](int t) {
+        const uint32_t begin = (uint64_t)count * t / numChunks, end = (uint64_t)count * (t + 1) / numChunks;
+        for (uint32_t i = begin; i < end; i++) cache.qcoeffs[i] = (uint16_t)((cache.coeffs[i] - cache.min) * scale + 0.5f);
+    });
+}
+
+/**
+ * free the least recently used caches that are not in `keep` until `extra` more bytes fit in `coeffCacheBudget`.
+ * The caches in `keep` are never freed, even if they alone exceed the budget
+ */
+void evictCoeffCaches(int keep, size_t extra) {
+    if (coeffCacheBudget == 0) return;
+    auto bytesOf = [](const CoeffCache& cache) {
+        return cache.coeffs != NULL ? count * sizeof(float) : cache.qcoeffs != NULL ? count * sizeof(uint16_t) : 0;
+    };
+    size_t used = 0;
+    for (const auto& cache : sortCoeffCache) used += bytesOf(cache);
+    while (used + extra > coeffCacheBudget) {
+        int lru = -1;
+        for (int f = 0; f < NUM_SORT_FUNCS; f++) {
+            const auto& cache = sortCoeffCache[f];
+            if (!(keep >> f & 1) && cache.computed() && (lru < 0 || cache.lastUse < sortCoeffCache[lru].lastUse)) lru = f;
+        }
+        if (lru < 0) return;
+        used -= bytesOf(sortCoeffCache[lru]);
+        releaseCache(sortCoeffCache[lru]);
+    }
+}
+
+/**
+ * compute the coefficient arrays of the sort functions in `mask` (bit i for sortFunctions[i]) that are not cached yet,
+ * first evicting the least recently used caches that are not requested if they would exceed `coeffCacheBudget`
+ */
+void computeCoeffs(int mask) {
+    const int requested = mask;
+    coeffCacheClock++;
+    for (int f = 0; f < NUM_SORT_FUNCS; f++) {
+        if (!(mask >> f & 1)) continue;
+        sortCoeffCache[f].lastUse = coeffCacheClock;
+        if (sortCoeffCache[f].computed()) mask &= ~(1 << f);
+    }
+    if (mask == 0) return;
+    evictCoeffCaches(requested, std::popcount((uint32_t)mask) * (size_t)count * (compactCache ? sizeof(uint16_t) : sizeof(float)));
+
+    // with collapsed sections, similarity compares the classes of the sections
+    const auto* savedRef = refSchedule;
+    vector<uint16_t> refClasses;
+    if ((mask & (1 << 5)) && !classRep.empty() && refSchedule != NULL) {
+        for (int j = 0; j < numCourses; j++)
+            refClasses.push_back(refSchedule[j] < classRep.size() ? classRep[refSchedule[j]] : refSchedule[j]);
+        refSchedule = refClasses.data();
+    }
+    if (compactCache) {
+        // each function is evaluated into `coeffs`, which is not used until the sort combines the coefficients,
+        // and quantized from there, so that no float array is allocated
+        for (int f = 0; f < NUM_SORT_FUNCS; f++) {
+            if (!(mask >> f & 1)) continue;
+            auto& cache = sortCoeffCache[f];
+            cache.coeffs = coeffs;
+            evaluateCoeffs(1 << f);
+            quantizeCoeffs(cache);
+            cache.coeffs = NULL;
+        }
+    } else {
+        for (int f = 0; f < NUM_SORT_FUNCS; f++) {
+            if (mask >> f & 1) sortCoeffCache[f].coeffs = new float[count];
+        }
+        evaluateCoeffs(mask);
+    }
+    refSchedule = savedRef;
+}
+
+/**
+ * get the computed/cached coefficient array for a specific sorting option.
+ * @param funcIdx the index of the sorting option
+ * @returns the computed/cached coefficients
+ */
+CoeffCache computeCoeffFor(int funcIdx) {
+    computeCoeffs(1 << funcIdx);
+    return sortCoeffCache[funcIdx];
+}
+
+/**
+ * order the schedules by Pareto layer over the enabled options (SortMode::pareto). The schedules are sorted once
+ * by the sum of their normalized coefficients (`coeffs`), then by their keys, so that a schedule comes after those
+ * dominating it. Only the first layer is found here, the others are found on demand by `getSchedule` and `getLayerStart`
+ * (see `peelLayer`), so that each layer costs a scan of the schedules not in a layer yet, like the partial sorts of the other modes
+ */
+void sortPareto(const SortOption* options, int enabled) {
+    for (int i = 0; i < enabled; i++) sortKeys[i] = sortKeyOf(computeCoeffFor(options[i].idx), options[i].reverse);
+    numSortKeys = enabled;
+    const int numChunks = count < PARALLEL_EVAL_MIN ? 1 : numThreads * 4;
+    parallelFor(numChunks, [&](int t) {
+        const uint32_t begin = (uint64_t)count * t / numChunks, end = (uint64_t)count * (t + 1) / numChunks;
+        memset(coeffs + begin, 0, (end - begin) * sizeof(float));
+        for (int k = 0; k < enabled; k++) {
+            const auto key = sortKeys[k];
+            const auto& cache = sortCoeffCache[options[k].idx];
+            if (key.coeffs == NULL) {
+                const uint16_t flip = key.rev < 0 ? 0xFFFF : 0;
+                for (uint32_t i = begin; i < end; i++) coeffs[i] += (key.qcoeffs[i] ^ flip) * (1.0f / 65535);
+                continue;
+            }
+            const float range = cache.max - cache.min;
+            const float ratio = range > 0 ? 1 / range : 0;
+            for (uint32_t i = begin; i < end; i++) {
+                const float val = key.coeffs[i];
+                coeffs[i] += (key.rev < 0 ? cache.max - val : val - cache.min) * ratio;
+            }
+        }
+    });
+    // a schedule dominating another one has no greater sum, and their sums can only be equal by rounding (see `peelLayer`)
+    if (count >= RADIX_SORT_MIN) {
+        const SortKey byScore = {1.0f, coeffs, NULL};
+        radixSort(&byScore, 1);
+    } else {
+        for (uint32_t i = 0; i < count; i++) indices[i] = i;
+        std::sort(indices, indices + count, [](int a, int b) { return coeffs[a] < coeffs[b] || (coeffs[a] == coeffs[b] && a < b); });
+    }
+    paretoLayers = {0};
+    // the order of the collapsed schedules is needed as a whole to locate the expanded ones (see `expandPrefix`)
+    peelLayers(classRep.empty() ? 0 : count);
+}
+
+/** a meeting of a section on some day */
+struct Meeting {
+    int start, end, section;
+};
+
+/**
+ * append the non-empty meetings of the sections on `day` to `out` (empty meetings never overlap),
+ * sorted by their start times
+ * @param offsets the offsets of the time arrays of the sections in timeArrayContent: uint16_t for the time arrays
+ * of `generate`, uint32_t for those of `loadCatalog`
+ */
+template <typename Offset>
+void collectMeetings(int numSections, const Offset* __restrict__ offsets, const uint16_t* __restrict__ timeArrayContent,
+                     int day, vector<Meeting>& out) {
+    for (int s = 0; s < numSections; s++) {
+        for (uint32_t j = offsets[s * 8 + day], end = offsets[s * 8 + day + 1]; j < end; j += 3) {
+            if (timeArrayContent[j] < timeArrayContent[j + 1])
+                out.push_back({timeArrayContent[j], timeArrayContent[j + 1], s});
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const Meeting& a, const Meeting& b) { return a.start < b.start; });
+}
+
+/** whether the date ranges of section i and j intersect. All date ranges intersect if dateRanges is NULL */
+inline bool datesIntersect(const double* __restrict__ dateRanges, int i, int j) {
+    return dateRanges == NULL || calcOverlap(dateRanges[2 * i], dateRanges[2 * i + 1], dateRanges[2 * j], dateRanges[2 * j + 1]) != -1;
+}
+
+/**
+ * the sections of a catalog loaded once by `loadCatalog`, from which `generateFromCatalog` selects the sections
+ * to generate schedules of by their indices
+ */
+struct CatalogStore {
+    int numSections = 0;
+    /** the offsets of the time arrays of all sections, followed by their content (see `loadCatalog`) */
+    const uint32_t* offsets = NULL;
+    const uint16_t* timeArrayContent = NULL;
+    /** the first and the last date of section i at 2i and 2i + 1 */
+    const double* dateRanges = NULL;
+    /** the meetings of all sections on each day, sorted by their start times */
+    vector<Meeting> meetings[7];
+    /** the length of the longest meeting on each day */
+    int maxLength[7];
+    /**
+     * conflictRows[i] is the bitset of the sections conflicting with section i, computed when section i is first selected.
+     * Bit i is set if section i has any meeting, as it conflicts with itself when it is selected twice
+     */
+    vector<vector<uint64_t>> conflictRows;
+
+    void load(int n, const uint32_t* ta, const double* dates) {
+        free((void*)offsets);
+        free((void*)dateRanges);
+        numSections = n;
+        offsets = ta;
+        timeArrayContent = (const uint16_t*)(ta + n * 8);
+        dateRanges = dates;
+        for (int d = 0; d < 7; d++) {
+            meetings[d].clear();
+            collectMeetings(n, offsets, timeArrayContent, d, meetings[d]);
+            maxLength[d] = 0;
+            for (const auto& m : meetings[d]) maxLength[d] = std::max(maxLength[d], m.end - m.start);
+        }
+        conflictRows.assign(n, {});
+    }
+
+    /** @returns the conflict bitset of section i (see `conflictRows`) */
+    const vector<uint64_t>& conflictRow(int i) {
+        auto& row = conflictRows[i];
+        if (!row.empty()) return row;
+        row.assign((numSections + 63) / 64, 0);
+        for (int d = 0; d < 7; d++) {
+            const auto& dayMeetings = meetings[d];
+            for (uint32_t j = offsets[i * 8 + d], end = offsets[i * 8 + d + 1]; j < end; j += 3) {
+                const int start = timeArrayContent[j], finish = timeArrayContent[j + 1];
+                if (start >= finish) continue;
+                // the meetings overlapping [start, finish) start after start - maxLength[d] and before finish
+                auto it = std::lower_bound(dayMeetings.begin(), dayMeetings.end(), start - maxLength[d],
+                                           [](const Meeting& m, int t) { return m.start <= t; });
+                for (; it != dayMeetings.end() && it->start < finish; it++) {
+                    if (it->end > start && datesIntersect(dateRanges, i, it->section))
+                        row[it->section / 64] |= 1ULL << (it->section % 64);
+                }
+            }
+        }
+        return row;
+    }
+
+    /**
+     * @returns the time array of the sections at `ids`, in the same format as in `generate` (with uint16_t offsets),
+     * allocated by malloc. NULL on memory allocation failure
+     */
+    uint16_t* timeArrayOf(const int* __restrict__ ids, int n) const {
+        int contentLen = 0;
+        for (int i = 0; i < n; i++) contentLen += offsets[ids[i] * 8 + 7] - offsets[ids[i] * 8];
+        auto* out = (uint16_t*)calloc(n * 8 + contentLen + 1, sizeof(uint16_t));
+        if (out == NULL) return NULL;
+        // copy the time arrays of the sections, with their offsets shifted
+        uint16_t* content = out + n * 8;
+        int len = 0;
+        for (int i = 0; i < n; i++) {
+            const int id = ids[i];
+            const uint32_t first = offsets[id * 8];
+            for (int d = 0; d < 8; d++) out[i * 8 + d] = offsets[id * 8 + d] - first + len;
+            const int secLen = offsets[id * 8 + 7] - first;
+            memcpy(content + len, timeArrayContent + first, secLen * sizeof(uint16_t));
+            len += secLen;
+        }
+        return out;
+    }
+
+    /** fill the n * n conflict matrix of the sections at `ids`, in the same format as in `generate` */
+    void conflictsOf(const int* __restrict__ ids, int n, uint8_t* __restrict__ conflictCache) {
+        for (int i = 0; i < n; i++) {
+            const auto& row = conflictRow(ids[i]);
+            for (int j = 0; j < n; j++) conflictCache[i * n + j] = i != j && (row[ids[j] / 64] >> (ids[j] % 64) & 1);
+        }
+    }
+} catalog;
+
+/**
+ * the sections selected by the last `generateFromCatalog`, kept so that the selection can be edited incrementally
+ * (see `addCourse`, `addSection`, `removeSection` and `removeCourse`)
+ */
+struct Selection {
+    /** same as the parameters of `generateFromCatalog` */
+    vector<int> sectionLens, sectionIds;
+    int maxNumSchedules = 0;
+    /**
+     * whether `schedules` holds all valid schedules of the selection as rows, so that an edit can update them
+     * instead of generating them again. False if they were truncated by maxNumSchedules, or they are
+     * the best ones only (GenFlag::topK) or a sample (GenFlag::sample), or they are not stored as rows (factored, collapsed or packed)
+     */
+    bool editable = false;
+    /** whether the blocks of the schedules were not stored by `generate` (GenFlag::lazyBlocks) */
+    bool lazyBlocks = false;
+} selection;
+
+/**
+ * make `schedules` hold at least len uint16_t, keeping its content
+ * @returns false on memory allocation failure
+ */
+bool reserveSchedules(int len) {
+    if (len <= scheduleLen) return true;
+    auto* newMem = (uint16_t*)realloc(schedules, len * sizeof(uint16_t));
+    if (newMem == NULL) return false;
+    schedules = newMem;
+    scheduleLen = len;
+    return true;
+}
+
+/**
+ * the state of a generation run in steps (see `startGenerate`): the inputs of `generate` and its depth first search,
+ * suspended between two calls of `generateStep`. The partial schedule is kept in `schedules` after the complete ones
+ */
+struct SteppedSearch {
+    /** same as the parameters of `generate` */
+    const int* __restrict__ sectionLens = NULL;
+    const uint8_t* __restrict__ conflictCache = NULL;
+    const uint16_t* __restrict__ timeArray = NULL;
+    /** same as in `generate`, multiplied by the number of courses */
+    int maxNumSchedules = 0;
+    /** whether GenFlag::lazyBlocks was set, so that the blocks are not built when the search is complete */
+    bool lazyBlocks = false;
+    /** the course and the section to try next */
+    int courseIdx = 0, sectionIdx = 0;
+    /** the total length of the time arrays of the schedules found so far */
+    uint32_t timeLen = 0;
+    /** whether a search is suspended */
+    bool active = false;
+
+    /** end the search and free its inputs */
+    void finish() {
+        active = false;
+#ifndef _TEST
+        free((void*)sectionLens);
+        free((void*)conflictCache);
+        free((void*)timeArray);
+#endif
+    }
+
+    /** end the suspended search, if any */
+    void cancel() {
+        if (active) finish();
+    }
+} stepped;
+
+/** forget the order of the last sort and the substitutions derived from it, after the schedules changed */
+void clearSortState() {
+    expandedCount = count;
+    expandPrefix.clear();
+    sortFences.clear();
+    sortedPages.clear();
+    paretoLayers.clear();
+    hasPrevOrder = false;
+}
+
+/**
+ * evaluate the cached float coefficients on the schedules appended after the first oldCount ones,
+ * keeping those already computed. The compact caches are dropped, as their range may change
+ */
+void extendCoeffCaches(uint32_t oldCount) {
+    int mask = 0;
+    for (int f = 0; f < NUM_SORT_FUNCS; f++) {
+        auto& cache = sortCoeffCache[f];
+        if (cache.coeffs == NULL) {
+            releaseCache(cache);
+            continue;
+        }
+        auto* coeffs = new float[count];
+        std::copy_n(cache.coeffs, oldCount, coeffs);
+        delete[] cache.coeffs;
+        cache.coeffs = coeffs;
+        mask |= 1 << f;
+    }
+    if (mask) evaluateCoeffs(mask, oldCount);
+}
+
+extern "C" {
+
+/**
+ * initialize the global indices, offsets and blocks array so the sort function can use then
+*/
+void addToEval(const uint16_t* __restrict__ timeArray, const int* __restrict__ sectionLens) {
+    const auto* timeArrayContent = sortTimeArrayContent(timeArray, sectionLens[numCourses]);
+    if (evalRanges.empty()) {
+        addToEvalRange(timeArray, timeArrayContent, sectionLens, 0, count, 0);
+    } else {
+        parallelFor(evalRanges.size(), [&](int i) {
+            const auto& range = evalRanges[i];
+            addToEvalRange(timeArray, timeArrayContent, sectionLens, range.begin, range.end, range.offset);
+        });
+    }
+}
+/**
+ * backing storage for indices, coeffs, offsets and blocks
+ */
+void* evalMem = NULL;
+/**
+ * length of the evalMem in bytes
+ */
+uint32_t evalMemSize = 0;
+
+/**
+ * make `evalMem` large enough for `count` schedules whose blocks take timeLen uint16_t in total,
+ * and lay out indices, coeffs, offsets and blocks in it. The content is kept, but not moved to the new layout
+ * @param storeBlocks whether the blocks are stored. If not, blocks is NULL and timeLen is ignored
+ * @returns false on memory allocation failure
+ */
+bool allocEval(uint32_t timeLen, bool storeBlocks) {
+    // handle reallocation of memory
+    static_assert(sizeof(int) == sizeof(float));
+    static_assert(alignof(int) == alignof(float));
+    if (!storeBlocks) timeLen = 0;
+    uint32_t newMemSize = count * 3 * sizeof(int) + timeLen * sizeof(uint16_t);
+    if (newMemSize > evalMemSize) {
+        void* newMem = realloc(evalMem, newMemSize);
+        if (newMem == NULL) return false;
+        evalMem = newMem;
+        evalMemSize = newMemSize;
+    }
+    // the layout depends on count, so it has to be updated even if the memory is reused
+    indices = (int*)evalMem;
+    coeffs = ((float*)evalMem) + count;
+    offsets = ((int*)evalMem) + 2 * count;
+    blocks = storeBlocks ? ((uint16_t*)evalMem) + 6 * count : NULL;
+    return true;
+}
+
+/**
+ * @param numCourses number of courses
+ * @param maxNumSchedules the maximum number of schedules to generate.
+ * With GenFlag::topK, the number of best schedules to keep
+ * @param sectionLens a prefix array that stores the number of sections in each course
+ * sectionLens[i] is the total number of sections in courses 0 to i - 1 inclusive
+ * sectionLens[numCourses] is the total number of sections 
+ * @param conflictCache the conflict cache matrix which caches the conflict between each pair of sections.
+ * To check whether section i conflicts with section j: conflictCache[i * numSections + j] (or conflictCache[j * numSections + i])
+ * Packed into bitsets for the searches with forward checking (see GenFlag)
+ * @param timeArray TODO: add description.
+ * @note the pointers passed in to this function should point to dynamically allocated memory. They will be freed before this function returns. 
+ * @returns the number of schedules generated. Returns -1 on memory allocation failure
+ */
+int generate(const int numCourses, int maxNumSchedules, const int* __restrict__ sectionLens, const uint8_t* __restrict__ conflictCache, const uint16_t* __restrict__ timeArray) {
+    stepped.cancel();
+    ScheduleGenerator::numCourses = numCourses;
+    selection.editable = false;
+    maxNumSchedules *= numCourses;
+    const int numSections = sectionLens[numCourses];
+    factors.clear();
+    classRep.clear();
+    classReps.clear();
+    expandPrefix.clear();
+    sortFences.clear();
+    sortedPages.clear();
+    paretoLayers.clear();
+    hasPrevOrder = false;
+    compactCache = genFlags & GenFlag::compactCoeffs;
+    packed = false;
+    packedSchedules.clear();
+    constraints.prepare(numCourses, numSections, timeArray);
+    // sampling replaces the search, so the flags of the other searches are ignored
+    const bool sampling = genFlags & GenFlag::sample;
+    vector<vector<int>> components;
+    if (!sampling && !keepsBest() && (genFlags & (GenFlag::factorize | GenFlag::collapse))) {
+        if (!packConflicts(numSections, conflictCache)) return -1;
+        if (genFlags & GenFlag::collapse) buildClasses(numCourses, sectionLens, timeArray);
+        // the constraints on schedules tie the components together
+        if ((genFlags & GenFlag::factorize) && !constraints.onSchedules()) components = findComponents(numCourses, sectionLens);
+    }
+    const bool packing = !sampling && (genFlags & GenFlag::pack) && !keepsBest() && components.size() <= 1;
+    // the blocks are not stored for factored schedules, so keep what is needed to build them on demand
+    const bool lazyBlocks = (genFlags & GenFlag::lazyBlocks) || components.size() > 1;
+    selection.lazyBlocks = lazyBlocks;
+    computeSectionStats(numSections, timeArray);
+    evalTimeArray.clear();
+    evalSectionLens.clear();
+    if (lazyBlocks) {
+        evalTimeArray.assign(timeArray, timeArray + (numSections ? numSections * 8 + timeArray[numSections * 8 - 1] : 0));
+        evalSectionLens.assign(sectionLens, sectionLens + numCourses + 1);
+        evalNumSections = numSections;
+    }
+    // factored and packed schedules are not stored as rows
+    if (components.size() <= 1 && !packing && maxNumSchedules + numCourses > scheduleLen) {
+        // extra 1x numCourses to prevent write out of bound at computeSchedules at *!*!*
+        scheduleLen = maxNumSchedules + numCourses;
+        auto* newMem = (uint16_t*)realloc(schedules, scheduleLen * 2);
+        // handle allocation failure
+        if (newMem == NULL) return -1;
+        schedules = newMem;
+    }
+
+    /** the total length of the time array that we need to allocate for schedules generated */
+    uint32_t timeLen = 0;
+    /** current course index */
+    int courseIdx = 0;
+    /** the index of the current section */
+    int sectionIdx = 0;
+    /** pointer to the current schedule */
+    auto* __restrict__ curSchedule = schedules;
+    evalRanges.clear();
+    if (components.size() > 1) {
+        count = generateFactors(components, maxNumSchedules / numCourses, sectionLens);
+        goto alloc;
+    }
+    if (sampling) {
+        if (!packConflicts(numSections, conflictCache)) return -1;
+        const int rows = sampleSchedules(numCourses, maxNumSchedules / std::max(numCourses, 1), sectionLens);
+        // otherwise, all schedules are generated by the plain search
+        if (rows >= 0) {
+            curSchedule += rows * numCourses;
+            for (auto* p = schedules; p < curSchedule; p++) timeLen += timeArray[*p * 8 + 7] - timeArray[*p * 8];
+            goto end;
+        }
+    }
+    if (!sampling && keepsBest()) {
+        if (!packConflicts(numSections, conflictCache)) return -1;
+        static ForwardChecker checker;
+        static TopKSearch search;
+        checker.init(numCourses, sectionLens, genFlags & GenFlag::backjump);
+        search.init(numCourses, maxNumSchedules / numCourses, sectionLens, timeArray);
+        const auto* row = checker.row.data();
+        if (search.combined) {
+            auto reject = [&](int level) { return constraints.active && !constraints.push(level - 1, row[level - 1]); };
+            while (checker.next(reject)) {
+                if (!constraints.active || constraints.accepts(row, numCourses)) search.extendRange(row);
+            }
+            search.fixRange();
+            checker.init(numCourses, sectionLens, genFlags & GenFlag::backjump);
+            row = checker.row.data();
+        }
+        auto prune = [&](int level) {
+            return (constraints.active && !constraints.push(level - 1, row[level - 1])) || search.prune(row, level);
+        };
+        while (checker.next(prune)) {
+            if (!constraints.active || constraints.accepts(row, numCourses)) search.add(row);
+        }
+        curSchedule += search.finish(schedules) * numCourses;
+        for (auto* p = schedules; p < curSchedule; p++) timeLen += timeArray[*p * 8 + 7] - timeArray[*p * 8];
+        goto end;
+    }
+    if (!sampling && (genFlags & GenFlag::parallel)) {
+        if (!packConflicts(numSections, conflictCache)) return -1;
+        if (packing) initPacking(numCourses, sectionLens);
+        timeLen = generateParallel(numCourses, maxNumSchedules, sectionLens, timeArray);
+        goto counted;
+    }
+    if (!sampling && (genFlags & (GenFlag::forwardCheck | GenFlag::dynamicOrder | GenFlag::backjump | GenFlag::collapse | GenFlag::pack))) {
+        if (!packConflicts(numSections, conflictCache)) return -1;
+        static ForwardChecker checker;
+        checker.init(numCourses, sectionLens, genFlags);
+        // the days of the partial schedules are only known in the input order of the courses
+        const bool pruneDays = constraints.active && !checker.dynamic;
+        const auto* row = checker.row.data();
+        auto next = [&]() {
+            while (pruneDays ? checker.next([&](int level) { return !constraints.push(level - 1, row[level - 1]); })
+                             : checker.next()) {
+                if (!constraints.active || constraints.accepts(row, numCourses)) return true;
+            }
+            return false;
+        };
+        if (packing) {
+            initPacking(numCourses, sectionLens);
+            const uint32_t maxRows = maxNumSchedules / std::max(numCourses, 1);
+            uint32_t rows = 0;
+            while (rows < maxRows && next()) {
+                packRow(rows++, checker.row.data());
+                for (int i = 0; i < numCourses; i++) {
+                    int _off = checker.row[i] * 8;
+                    timeLen += timeArray[_off + 7] - timeArray[_off];
+                }
+            }
+            count = rows;
+            goto counted;
+        }
+        while (curSchedule - schedules < maxNumSchedules && next()) {
+            for (int i = 0; i < numCourses; i++) {
+                int _off = (curSchedule[i] = checker.row[i]) * 8;
+                timeLen += timeArray[_off + 7] - timeArray[_off];
+            }
+            curSchedule += numCourses;
+        }
+        goto end;
+    }
+    while (true) {
+        if (courseIdx >= numCourses) {  // we have finished building the current schedule
+            if (!constraints.active || constraints.accepts(curSchedule, numCourses)) {
+                // accumulate the length of the time arrays combined in each schedule
+                // and copy the current schedule to next schedule
+                for (int i = 0; i < numCourses; i++) {
+                    int secIdx = (curSchedule[numCourses + i] = curSchedule[i]);  // *!*!*
+                    int _off = secIdx * 8;
+                    timeLen += timeArray[_off + 7] - timeArray[_off];
+                }
+
+                curSchedule += numCourses;
+                if (curSchedule - schedules >= maxNumSchedules) goto end;
+            }
+            sectionIdx = curSchedule[--courseIdx] + 1;
+        }
+    next:;
+        /**
+         * when all possibilities in on class have exhausted, explore the next possibility in the previous class
+         * reset choices of the later classes to 0
+         */
+        while (sectionIdx >= sectionLens[courseIdx + 1]) {
+            // return to the previous class
+            // if all possibilities are exhausted, break out the loop
+            if (--courseIdx < 0) goto end;
+
+            // explore the next possibility
+            sectionIdx = curSchedule[courseIdx] + 1;
+            for (int i = courseIdx + 1; i < numCourses; i++) curSchedule[i] = 0;
+        }
+
+        // check conflict between the newly chosen section and the sections already in the schedule
+        int temp = sectionIdx * numSections;
+        for (int i = 0; i < courseIdx; i++) {
+            if (conflictCache[temp + curSchedule[i]]) {
+                // if conflict, increment the section index
+                ++sectionIdx;
+                goto next;
+            }
+        }
+        if (constraints.active && !constraints.push(courseIdx, sectionIdx)) {
+            ++sectionIdx;
+            goto next;
+        }
+
+        // if the section does not conflict with any previously chosen sections,
+        // record the section and go to the next class,
+        curSchedule[courseIdx++] = sectionIdx;
+        // set choice num to be the first section of the next class
+        sectionIdx = sectionLens[courseIdx];
+    }
+end:;
+    count = (curSchedule - schedules) / numCourses;
+counted:;
+    timeLen += 8 * count;
+    if (packed) packedSchedules.shrink_to_fit();
+alloc:;
+    expandedCount = count;
+    if (!classRep.empty()) {
+        vector<uint16_t> scratch(numCourses);
+        expandedCount = 0;
+        for (uint32_t i = 0; i < count; i++) expandedCount = addSat(expandedCount, numExpansions(rowOf(i, scratch.data())));
+    }
+
+    if (!allocEval(timeLen, !lazyBlocks)) return -1;
+    if (!lazyBlocks) addToEval(timeArray, sectionLens);
+
+// cleanup
+#ifndef _TEST
+    free((void*)sectionLens);
+    free((void*)conflictCache);
+    free((void*)timeArray);
+#endif
+    for (auto& cache : sortCoeffCache) releaseCache(cache);
+    return count;
+}
+
+/**
+ * start generating the schedules in steps (see `generateStep`), so that the schedules found so far can be shown
+ * and sorted before the search is complete. A suspended search is cancelled by the next `startGenerate` or `generate`.
+ * Until the search is complete, the blocks are built on demand as with GenFlag::lazyBlocks.
+ * Only the plain depth first search is run in steps: with any flag other than lazyBlocks and compactCoeffs,
+ * the schedules are generated at once by `generate`, and the first step completes the search.
+ * Parameters are the same as `generate`
+ * @note the pointers passed in are freed when the search is complete or cancelled
+ * @returns the number of schedules generated so far, or -1 on memory allocation failure
+ */
+int startGenerate(const int numCourses, int maxNumSchedules, const int* __restrict__ sectionLens,
+                  const uint8_t* __restrict__ conflictCache, const uint16_t* __restrict__ timeArray) {
+    stepped.cancel();
+    if (numCourses == 0 || (genFlags & ~(GenFlag::lazyBlocks | GenFlag::compactCoeffs)))
+        return generate(numCourses, maxNumSchedules, sectionLens, conflictCache, timeArray);
+    ScheduleGenerator::numCourses = numCourses;
+    selection.editable = false;
+    maxNumSchedules *= numCourses;
+    const int numSections = sectionLens[numCourses];
+    factors.clear();
+    classRep.clear();
+    classReps.clear();
+    compactCache = genFlags & GenFlag::compactCoeffs;
+    packed = false;
+    packedSchedules.clear();
+    computeSectionStats(numSections, timeArray);
+    constraints.prepare(numCourses, numSections, timeArray);
+    evalTimeArray.assign(timeArray, timeArray + (numSections ? numSections * 8 + timeArray[numSections * 8 - 1] : 0));
+    evalSectionLens.assign(sectionLens, sectionLens + numCourses + 1);
+    evalNumSections = numSections;
+    evalRanges.clear();
+    // extra 1x numCourses for the copy of the last schedule, as in generate
+    if (!reserveSchedules(maxNumSchedules + numCourses)) return -1;
+    count = 0;
+    if (!allocEval(0, false)) return -1;
+    clearSortState();
+    for (auto& cache : sortCoeffCache) releaseCache(cache);
+    stepped = {sectionLens, conflictCache, timeArray, maxNumSchedules, (genFlags & GenFlag::lazyBlocks) != 0, 0, 0, 0, true};
+    return 0;
+}
+
+/**
+ * continue the search started by `startGenerate` for at most `budget` steps, each trying one section of one course.
+ * Between the steps, the schedules found so far can be sorted and read as usual, and the float coefficients
+ * cached by the last sort are extended to the new schedules. When the search is complete, the schedules are
+ * the same, in the same order, as those of `generate`
+ * @returns 1 if the search is complete, 0 if it is suspended again, -1 on memory allocation failure
+ */
+int generateStep(int budget) {
+    if (!stepped.active) return 1;
+    const auto* __restrict__ sectionLens = stepped.sectionLens;
+    const auto* __restrict__ conflictCache = stepped.conflictCache;
+    const auto* __restrict__ timeArray = stepped.timeArray;
+    const int numSections = sectionLens[numCourses];
+    int courseIdx = stepped.courseIdx, sectionIdx = stepped.sectionIdx;
+    auto* __restrict__ curSchedule = schedules + count * numCourses;
+    // the same search as in generate, with the gotos replaced by the steps of the loop
+    bool complete = false;
+    for (; budget > 0; budget--) {
+        if (courseIdx >= numCourses) {
+            if (!constraints.active || constraints.accepts(curSchedule, numCourses)) {
+                for (int i = 0; i < numCourses; i++) {
+                    int secIdx = (curSchedule[numCourses + i] = curSchedule[i]);
+                    stepped.timeLen += timeArray[secIdx * 8 + 7] - timeArray[secIdx * 8];
+                }
+                curSchedule += numCourses;
+                if (curSchedule - schedules >= stepped.maxNumSchedules) {
+                    complete = true;
+                    break;
+                }
+            }
+            sectionIdx = curSchedule[--courseIdx] + 1;
+        }
+        while (sectionIdx >= sectionLens[courseIdx + 1] && --courseIdx >= 0) sectionIdx = curSchedule[courseIdx] + 1;
+        if (courseIdx < 0) {
+            complete = true;
+            break;
+        }
+        const auto* __restrict__ conflicts = conflictCache + sectionIdx * numSections;
+        bool conflict = false;
+        for (int i = 0; i < courseIdx && !conflict; i++) conflict = conflicts[curSchedule[i]];
+        if (conflict || (constraints.active && !constraints.push(courseIdx, sectionIdx))) {
+            ++sectionIdx;
+            continue;
+        }
+        curSchedule[courseIdx++] = sectionIdx;
+        sectionIdx = sectionLens[courseIdx];
+    }
+    stepped.courseIdx = courseIdx;
+    stepped.sectionIdx = sectionIdx;
+    const uint32_t oldCount = count;
+    count = (curSchedule - schedules) / numCourses;
+    if (!complete && count == oldCount) return 0;
+
+    // lay out the schedules as generate does, building their blocks once the search is complete
+    const bool storeBlocks = complete && !stepped.lazyBlocks;
+    if (!allocEval(stepped.timeLen + 8 * count, storeBlocks)) return -1;
+    if (storeBlocks) {
+        addToEval(timeArray, sectionLens);
+        evalTimeArray.clear();
+        evalSectionLens.clear();
+    }
+    clearSortState();
+    extendCoeffCaches(oldCount);
+    if (!complete) return 0;
+    stepped.finish();
+    return 1;
+}
+
+/**
+ * fill the conflict matrix of the sections passed to `generate`: two sections conflict if any of their meetings overlap
+ * and their date ranges intersect. Each day is swept in the order of the start times, keeping the meetings
+ * that have not ended yet, so that only the pairs of overlapping meetings are visited instead of all pairs of sections
+ * @param numSections the number of sections
+ * @param timeArray the time arrays of the sections, in the same format as in `generate`
+ * @param dateRanges the first and the last date of section i at 2i and 2i + 1, or NULL if all date ranges intersect
+ * @param conflictCache the numSections * numSections matrix to fill
+ * @note dateRanges is freed, but timeArray and conflictCache are not, so that they can be passed to `generate`
+ */
+void buildConflictCache(int numSections, const uint16_t* __restrict__ timeArray, const double* __restrict__ dateRanges,
+                        uint8_t* __restrict__ conflictCache) {
+    memset(conflictCache, 0, (size_t)numSections * numSections);
+    vector<Meeting> meetings, ongoing;
+    for (int d = 0; d < 7; d++) {
+        meetings.clear();
+        collectMeetings(numSections, timeArray, timeArray + numSections * 8, d, meetings);
+        ongoing.clear();
+        for (const auto& m : meetings) {
+            // the meetings that end before m starts cannot overlap m or any meeting after it
+            ongoing.erase(std::remove_if(ongoing.begin(), ongoing.end(), [&m](const Meeting& o) { return o.end <= m.start; }),
+                          ongoing.end());
+            for (const auto& o : ongoing) {
+                const int i = o.section, j = m.section;
+                if (i == j || !datesIntersect(dateRanges, i, j)) continue;
+                // conflict is symmetric
+                conflictCache[i * numSections + j] = conflictCache[j * numSections + i] = 1;
+            }
+            ongoing.push_back(m);
+        }
+    }
+#ifndef _TEST
+    free((void*)dateRanges);
+#endif
+}
+
+/**
+ * load the sections of a catalog, replacing the previously loaded catalog (see `CatalogStore`)
+ * @param numSections the number of sections in the catalog
+ * @param timeArray the time arrays of the sections, in the same format as in `generate` except that the offsets
+ * (the first numSections * 8 elements) are uint32_t, as the content of a whole catalog is longer than 65535.
+ * The uint16_t content follows the offsets
+ * @param dateRanges the first and the last date of section i at 2i and 2i + 1
+ * @note the pointers are kept until the next call, which frees them
+ */
+void loadCatalog(int numSections, const uint32_t* __restrict__ timeArray, const double* __restrict__ dateRanges) {
+    catalog.load(numSections, timeArray, dateRanges);
+}
+
+/**
+ * generate the schedules of sections of the catalog loaded by `loadCatalog`. The time arrays and the conflicts
+ * of the selected sections are taken from the catalog, and the conflicts of each section are computed only once
+ * per catalog, so nothing but the indices of the sections is passed on each call.
+ * The other parameters are the same as in `generate`
+ * @param sectionIds sectionIds[sectionLens[i]] to sectionIds[sectionLens[i + 1]] - 1 are the indices in the catalog
+ * of the sections of course i
+ * @note sectionIds and sectionLens are freed
+ * @returns the same as `generate`
+ */
+int generateFromCatalog(const int numCourses, int maxNumSchedules, const int* __restrict__ sectionLens,
+                        const int* __restrict__ sectionIds) {
+    const int numSections = sectionLens[numCourses];
+    auto* timeArray = catalog.timeArrayOf(sectionIds, numSections);
+    auto* conflictCache = (uint8_t*)malloc((size_t)numSections * numSections + 1);
+    selection.editable = false;
+    if (timeArray == NULL || conflictCache == NULL) {
+        free(timeArray);
+        free(conflictCache);
+        return -1;
+    }
+    catalog.conflictsOf(sectionIds, numSections, conflictCache);
+    selection.sectionLens.assign(sectionLens, sectionLens + numCourses + 1);
+    selection.sectionIds.assign(sectionIds, sectionIds + numSections);
+    selection.maxNumSchedules = maxNumSchedules;
+#ifndef _TEST
+    free((void*)sectionIds);
+#endif
+    const int result = generate(numCourses, maxNumSchedules, sectionLens, conflictCache, timeArray);
+#ifdef _TEST
+    // generate does not free its inputs in the tests
+    free(conflictCache);
+    free(timeArray);
+#endif
+    selection.editable = result >= 0 && result < maxNumSchedules && factors.empty() && classRep.empty() && !packed &&
+                         !keepsBest() && !(genFlags & GenFlag::sample);
+    return result;
+}
+
+/**
+ * generate the schedules of `selection` from scratch, for the edits that cannot update the current ones
+ * @returns the same as `generateFromCatalog`
+ */
+int regenerate() {
+    const int numCourses = selection.sectionLens.size() - 1;
+    auto* sectionLens = (int*)malloc(selection.sectionLens.size() * sizeof(int));
+    auto* sectionIds = (int*)malloc(selection.sectionIds.size() * sizeof(int) + 1);
+    if (sectionLens == NULL || sectionIds == NULL) {
+        free(sectionLens);
+        free(sectionIds);
+        return -1;
+    }
+    std::copy(selection.sectionLens.begin(), selection.sectionLens.end(), sectionLens);
+    std::copy(selection.sectionIds.begin(), selection.sectionIds.end(), sectionIds);
+    const int result = generateFromCatalog(numCourses, selection.maxNumSchedules, sectionLens, sectionIds);
+#ifdef _TEST
+    free(sectionLens);
+    free(sectionIds);
+#endif
+    return result;
+}
+
+/**
+ * renumber the sections of `refSchedule` after an edit of the selection: section p becomes newPos[p]
+ * (0xFFFF if it is removed, unchanged if newPos is empty), and the courses added after the first oldNumCourses ones
+ * have no section in it
+ * @returns false on memory allocation failure
+ */
+bool remapRefSchedule(const vector<uint16_t>& newPos, int oldNumCourses, int newNumCourses) {
+    if (refSchedule == NULL) return true;
+    auto* ref = (uint16_t*)realloc((void*)refSchedule, newNumCourses * sizeof(uint16_t));
+    if (ref == NULL) return false;
+    for (int i = 0; i < newNumCourses; i++) {
+        if (i >= oldNumCourses) {
+            ref[i] = 0xFFFF;
+        } else if (!newPos.empty()) {
+            ref[i] = ref[i] < newPos.size() ? newPos[ref[i]] : 0xFFFF;
+        }
+    }
+    refSchedule = ref;
+    return true;
+}
+
+/**
+ * recompute what `generate` derives from the sections after an edit changed `selection` and `schedules`:
+ * the aggregates of the sections, the time arrays kept for the lazy blocks and the state of the last sort
+ * @returns the time array of the selection, allocated by malloc. NULL on memory allocation failure
+ */
+uint16_t* refreshSections() {
+    numCourses = selection.sectionLens.size() - 1;
+    const int numSections = selection.sectionIds.size();
+    auto* timeArray = catalog.timeArrayOf(selection.sectionIds.data(), numSections);
+    if (timeArray == NULL) return NULL;
+    computeSectionStats(numSections, timeArray);
+    if (selection.lazyBlocks) {
+        evalTimeArray.assign(timeArray, timeArray + (numSections ? numSections * 8 + timeArray[numSections * 8 - 1] : 0));
+        evalSectionLens = selection.sectionLens;
+        evalNumSections = numSections;
+    }
+    clearSortState();
+    evalRanges.clear();
+    return timeArray;
+}
+
+/**
+ * prepare `constraints` for the sections of `selection` after an edit changed them,
+ * so that the edit only adds the schedules that `generate` would keep
+ * @returns false on memory allocation failure
+ */
+bool prepareConstraints() {
+    // the constraints refer to the time array until the next edit
+    static uint16_t* timeArray = NULL;
+    free(timeArray);
+    timeArray = NULL;
+    const int numSections = selection.sectionIds.size();
+    if (constraints.onSections() || constraints.onSchedules()) {
+        timeArray = catalog.timeArrayOf(selection.sectionIds.data(), numSections);
+        if (timeArray == NULL) return false;
+    }
+    constraints.prepare(selection.sectionLens.size() - 1, numSections, timeArray);
+    return true;
+}
+
+/** replace `schedules` by `rows`, of numCourses sections each */
+bool storeRows(const vector<uint16_t>& rows) {
+    if (!reserveSchedules(rows.size() + numCourses)) return false;
+    std::copy(rows.begin(), rows.end(), schedules);
+    count = rows.size() / std::max(numCourses, 1);
+    return true;
+}
+
+/**
+ * add a course with the sections of the catalog at `sectionIds` after the courses of the last `generateFromCatalog`.
+ * Each schedule is extended by each section of the new course that does not conflict with it, in order,
+ * and the extended schedules are checked against the constraints (see `setConstraints`),
+ * so the schedules are the same as if they were generated from scratch. They are generated again if maxGap is set.
+ * The blocks are rebuilt and the cached coefficients are dropped, as every schedule changes
+ * @note sectionIds is freed
+ * @returns the number of schedules, or -1 on memory allocation failure
+ */
+int addCourse(int numSections, const int* __restrict__ sectionIds) {
+    const int first = selection.sectionIds.size();
+    selection.sectionIds.insert(selection.sectionIds.end(), sectionIds, sectionIds + numSections);
+    selection.sectionLens.push_back(first + numSections);
+#ifndef _TEST
+    free((void*)sectionIds);
+#endif
+    const int oldNumCourses = selection.sectionLens.size() - 2;
+    if (!remapRefSchedule({}, oldNumCourses, oldNumCourses + 1)) return -1;
+    // a new course can fill the gaps of a schedule rejected by maxGap, so that schedule has to be found again
+    if (!selection.editable || oldNumCourses == 0 || constraints.maxGap >= 0) return regenerate();
+    if (!prepareConstraints()) return -1;
+    vector<const vector<uint64_t>*> conflictRows(numSections);
+    for (int k = 0; k < numSections; k++) conflictRows[k] = &catalog.conflictRow(selection.sectionIds[first + k]);
+    const uint32_t maxCount = selection.maxNumSchedules;
+    uint32_t newCount = 0;
+    vector<uint16_t> rows;
+    for (uint32_t i = 0; i < count && newCount < maxCount; i++) {
+        const auto* row = schedules + i * oldNumCourses;
+        for (int k = 0; k < numSections && newCount < maxCount; k++) {
+            if (!constraints.allows(first + k)) continue;
+            const auto& conflicts = *conflictRows[k];
+            bool compatible = true;
+            for (int c = 0; c < oldNumCourses && compatible; c++) {
+                const int id = selection.sectionIds[row[c]];
+                compatible = !(conflicts[id / 64] >> (id % 64) & 1);
+            }
+            if (!compatible) continue;
+            rows.insert(rows.end(), row, row + oldNumCourses);
+            rows.push_back(first + k);
+            if (constraints.active && !constraints.accepts(rows.data() + rows.size() - (oldNumCourses + 1), oldNumCourses + 1)) {
+                rows.resize(rows.size() - (oldNumCourses + 1));
+                continue;
+            }
+            newCount++;
+        }
+    }
+    numCourses = oldNumCourses + 1;
+    if (!storeRows(rows)) return -1;
+    selection.editable = count < maxCount;
+    for (auto& cache : sortCoeffCache) releaseCache(cache);
+
+    auto* timeArray = refreshSections();
+    if (timeArray == NULL) return -1;
+    uint32_t timeLen = 8 * count;
+    for (uint32_t i = 0; i < count * numCourses; i++) timeLen += timeArray[schedules[i] * 8 + 7] - timeArray[schedules[i] * 8];
+    const bool allocated = allocEval(timeLen, !selection.lazyBlocks);
+    if (allocated && !selection.lazyBlocks) addToEval(timeArray, selection.sectionLens.data());
+    free(timeArray);
+    return allocated ? count : -1;
+}
+
+/**
+ * add the section of the catalog at `sectionId` to course `courseIdx` of the last `generateFromCatalog`.
+ * Only the schedules containing the new section (and satisfying the constraints) are enumerated, and they are appended after the current ones,
+ * whose blocks and cached coefficients are kept (those in the compact form are dropped, as their range may change).
+ * The schedules are the same as if they were generated from scratch, but not in the same order.
+ * They are generated again if they reach the maximum number of schedules
+ * @returns the number of schedules, or -1 on memory allocation failure
+ */
+int addSection(int courseIdx, int sectionId) {
+    auto& sectionLens = selection.sectionLens;
+    auto& sectionIds = selection.sectionIds;
+    const int pos = sectionLens[courseIdx + 1];
+    sectionIds.insert(sectionIds.begin() + pos, sectionId);
+    for (int c = courseIdx + 1; c < (int)sectionLens.size(); c++) sectionLens[c]++;
+    const int numSections = sectionIds.size();
+    vector<uint16_t> newPos(numSections - 1);
+    for (int p = 0; p < numSections - 1; p++) newPos[p] = p < pos ? p : p + 1;
+    if (!remapRefSchedule(newPos, numCourses, numCourses)) return -1;
+    if (!selection.editable) return regenerate();
+    if (!prepareConstraints()) return -1;
+    for (uint32_t i = 0; i < count * numCourses; i++) schedules[i] = newPos[schedules[i]];
+
+    // enumerate the schedules with the new section, in order, testing the conflicts on the rows cached by the catalog
+    vector<const uint64_t*> conflictRows(numSections);
+    for (int p = 0; p < numSections; p++) conflictRows[p] = catalog.conflictRow(sectionIds[p]).data();
+    auto conflict = [&](int a, int b) { return conflictRows[a][sectionIds[b] / 64] >> (sectionIds[b] % 64) & 1; };
+    const uint32_t maxCount = selection.maxNumSchedules;
+    uint32_t newCount = count;
+    vector<uint16_t> rows, row(numCourses);
+    row[courseIdx] = pos;
+    auto search = [&](auto& self, int c) -> void {
+        if (c == numCourses) {
+            if (constraints.active && !constraints.accepts(row.data(), numCourses)) return;
+            rows.insert(rows.end(), row.begin(), row.end());
+            newCount++;
+            return;
+        }
+        if (c == courseIdx) return self(self, c + 1);
+        for (int sec = sectionLens[c]; sec < sectionLens[c + 1] && newCount < maxCount; sec++) {
+            bool compatible = !conflict(sec, pos) && constraints.allows(sec);
+            for (int j = 0; j < c && compatible; j++) compatible = !conflict(sec, row[j]);
+            if (!compatible) continue;
+            row[c] = sec;
+            self(self, c + 1);
+        }
+    };
+    if (count < maxCount && constraints.allows(pos)) search(search, 0);
+    // generate keeps the first maxCount schedules in its order, which may not include all the current ones
+    if (newCount >= maxCount) return regenerate();
+
+    // append the new schedules, and their blocks after those of the current ones
+    const uint32_t oldCount = count;
+    const uint32_t oldTimeLen =
+        blocks != NULL && oldCount ? offsets[oldCount - 1] + blocks[offsets[oldCount - 1] + 7] : 0;
+    if (!reserveSchedules((newCount + 1) * numCourses)) return -1;
+    std::copy(rows.begin(), rows.end(), schedules + oldCount * numCourses);
+    count = newCount;
+    selection.editable = count < maxCount;
+    auto* timeArray = refreshSections();
+    if (timeArray == NULL) return -1;
+    uint32_t timeLen = oldTimeLen + 8 * (count - oldCount);
+    for (auto sec : rows) timeLen += timeArray[sec * 8 + 7] - timeArray[sec * 8];
+    if (!allocEval(timeLen, !selection.lazyBlocks)) {
+        free(timeArray);
+        return -1;
+    }
+    if (blocks != NULL) {
+        // the blocks are after the offsets, so they are moved first
+        memmove(blocks, (uint16_t*)evalMem + 6 * oldCount, oldTimeLen * sizeof(uint16_t));
+        memmove(offsets, (int*)evalMem + 2 * oldCount, oldCount * sizeof(int));
+        addToEvalRange(timeArray, sortTimeArrayContent(timeArray, numSections), sectionLens.data(), oldCount, count,
+                       oldTimeLen);
+    }
+    free(timeArray);
+    // evaluate the cached coefficients on the new schedules only
+    extendCoeffCaches(oldCount);
+    return count;
+}
+
+/**
+ * remove the section of the catalog at `sectionId` from course `courseIdx` of the last `generateFromCatalog`.
+ * The schedules without it are kept in order and those with it are dropped, so the schedules are the same
+ * as if they were generated from scratch. Their blocks and cached coefficients are moved along
+ * (those in the compact form are dropped, as their range may change)
+ * @returns the number of schedules, or -1 on memory allocation failure
+ */
+int removeSection(int courseIdx, int sectionId) {
+    auto& sectionLens = selection.sectionLens;
+    auto& sectionIds = selection.sectionIds;
+    const auto it = std::find(sectionIds.begin() + sectionLens[courseIdx], sectionIds.begin() + sectionLens[courseIdx + 1],
+                              sectionId);
+    if (it == sectionIds.begin() + sectionLens[courseIdx + 1]) return count;
+    const int pos = it - sectionIds.begin();
+    sectionIds.erase(it);
+    for (int c = courseIdx + 1; c < (int)sectionLens.size(); c++) sectionLens[c]--;
+    const int numSections = sectionIds.size();
+    vector<uint16_t> newPos(numSections + 1);
+    for (int p = 0; p <= numSections; p++) newPos[p] = p < pos ? p : p == pos ? 0xFFFF : p - 1;
+    if (!remapRefSchedule(newPos, numCourses, numCourses)) return -1;
+    if (!selection.editable) return regenerate();
+
+    // only course courseIdx can have the section
+    vector<uint32_t> kept;
+    for (uint32_t i = 0; i < count; i++) {
+        const auto* row = schedules + i * numCourses;
+        if (row[courseIdx] == pos) continue;
+        auto* dst = schedules + kept.size() * numCourses;
+        for (int c = 0; c < numCourses; c++) dst[c] = newPos[row[c]];
+        kept.push_back(i);
+    }
+    const uint32_t oldCount = count, m = kept.size();
+
+    // the blocks of the kept schedules move down to the new layout, in order, so that none is overwritten before it is moved.
+    // The new blocks may overlap the old offsets, so they are read first
+    uint32_t timeLen = 0;
+    vector<int> newOffsets;
+    if (blocks != NULL) {
+        vector<int> oldOffsets(offsets, offsets + oldCount);
+        auto* newBlocks = (uint16_t*)evalMem + 6 * m;
+        newOffsets.resize(m);
+        for (uint32_t j = 0; j < m; j++) {
+            const auto* block = blocks + oldOffsets[kept[j]];
+            const int len = block[7];
+            newOffsets[j] = timeLen;
+            memmove(newBlocks + timeLen, block, len * sizeof(uint16_t));
+            timeLen += len;
+        }
+    }
+    for (auto& cache : sortCoeffCache) {
+        if (cache.coeffs == NULL) {
+            releaseCache(cache);
+            continue;
+        }
+        cache.max = -std::numeric_limits<float>::infinity();
+        cache.min = std::numeric_limits<float>::infinity();
+        for (uint32_t j = 0; j < m; j++) {
+            const float coeff = cache.coeffs[j] = cache.coeffs[kept[j]];
+            cache.max = std::max(cache.max, coeff);
+            cache.min = std::min(cache.min, coeff);
+        }
+    }
+    count = m;
+    auto* timeArray = refreshSections();
+    if (timeArray == NULL) return -1;
+    free(timeArray);
+    // the memory only shrinks, so the moved blocks stay in place
+    allocEval(timeLen, blocks != NULL);
+    if (blocks != NULL) std::copy(newOffsets.begin(), newOffsets.end(), offsets);
+    return count;
+}
+
+/**
+ * remove course `courseIdx` of the last `generateFromCatalog`. The schedules are generated again,
+ * as the ones dropped because of a conflict with that course or the limit on their number become valid
+ * @returns the same as `generateFromCatalog`
+ */
+int removeCourse(int courseIdx) {
+    auto& sectionLens = selection.sectionLens;
+    auto& sectionIds = selection.sectionIds;
+    const int begin = sectionLens[courseIdx], numRemoved = sectionLens[courseIdx + 1] - begin;
+    const int oldNumCourses = sectionLens.size() - 1;
+    sectionIds.erase(sectionIds.begin() + begin, sectionIds.begin() + begin + numRemoved);
+    sectionLens.erase(sectionLens.begin() + courseIdx + 1);
+    for (int c = courseIdx + 1; c < (int)sectionLens.size(); c++) sectionLens[c] -= numRemoved;
+    if (refSchedule != NULL) {
+        auto* ref = (uint16_t*)refSchedule;
+        std::copy(ref + courseIdx + 1, ref + oldNumCourses, ref + courseIdx);
+        vector<uint16_t> newPos(sectionIds.size() + numRemoved);
+        for (int p = 0; p < (int)newPos.size(); p++) newPos[p] = p < begin ? p : p < begin + numRemoved ? 0xFFFF : p - numRemoved;
+        if (!remapRefSchedule(newPos, oldNumCourses - 1, oldNumCourses - 1)) return -1;
+    }
+    return regenerate();
+}
+
+/**
+ * count the number of valid schedules without generating them. Only the sections satisfying the constraints
+ * on single sections (see `setConstraints`) are counted. The constraints on whole schedules (maxDays and maxGap)
+ * are not applied, so the count is an upper bound of the number of schedules of `generate` if they are set.
+ * Parameters are the same as `generate`
+ * @note unlike `generate`, the pointers passed in are not freed, so they can be reused by a subsequent `generate`
+ * @returns the number of valid schedules, exact below 2^53, saturated at 2^64 - 1.
+ * Returns -1 on memory allocation failure
+ */
+double countSchedules(const int numCourses, const int* __restrict__ sectionLens, const uint8_t* __restrict__ conflictCache,
+                      const uint16_t* __restrict__ timeArray) {
+    const int numSections = sectionLens[numCourses];
+    if (!packConflicts(numSections, conflictCache)) return -1;
+    static ScheduleCounter counter;
+    return (double)counter.count(numCourses, sectionLens, constraints.onSections() ? constraints.sectionsAllowed(numSections, timeArray) : vector<uint64_t>());
+}
+
+/**
+ * sort the array of schedules according to their quality coefficients which will be computed by `computeCoeff`
+ */
+void sort() {
+    expandPrefix.clear();
+    sortFences.clear();
+    sortedPages.clear();
+    paretoLayers.clear();
+    static SortOption enabledOptions[NUM_SORT_FUNCS];
+
+    int enabled = getEnabledOptions(enabledOptions);
+    // When only the options or the weights changed (e.g. while a slider is dragged), the new order is usually close
+    // to the previous one, so the first page is repaired from the previous one (see `repairSort`).
+    // Ties are broken by the index, so the result is the same as starting from scratch.
+    // Otherwise, we start from the original order
+    // so that when the sort is performed repetitively, the result will be stable
+    const bool repair = hasPrevOrder && !isRandom() && enabled != 0;
+    if (!repair) {
+        for (uint32_t i = 0; i < count; i++)
+            indices[i] = i;
+    }
+    hasPrevOrder = false;
+    if (isRandom()) {
+        default_random_engine eng;
+        shuffle(indices, indices + count, eng);
+        return;
+    }
+    if (enabled == 0) return;
+    // evaluate all enabled sort functions together
+    int mask = 0;
+    for (int i = 0; i < enabled; i++) mask |= 1 << enabledOptions[i].idx;
+    computeCoeffs(mask);
+
+    if (sortMode == SortMode::pareto) {
+        sortPareto(enabledOptions, enabled);
+        hasPrevOrder = true;
+        return;
+    }
+    if (enabled == 1) {
+        // special case: only one sort option enabled
+        sortKeys[0] = sortKeyOf(computeCoeffFor(enabledOptions[0].idx), enabledOptions[0].reverse);
+        numSortKeys = 1;
+    } else if (sortMode == SortMode::combined) {
+        // for combiend sorting, we combine the coefficients from different sort options into
+        // a single array of coefficients, in parallel chunks
+        static CoeffCache caches[NUM_SORT_FUNCS];
+        for (int i = 0; i < enabled; i++) caches[i] = computeCoeffFor(enabledOptions[i].idx);
+        const int numChunks = count < PARALLEL_EVAL_MIN ? 1 : numThreads * 4;
+        parallelFor(numChunks, [&](int t) {
+            const uint32_t begin = (uint64_t)count * t / numChunks, end = (uint64_t)count * (t + 1) / numChunks;
+            memset(coeffs + begin, 0, (end - begin) * sizeof(float));
+            for (int i = 0; i < enabled; i++) {
+                const auto& option = enabledOptions[i];
+                const auto& cache = caches[i];
+                float range = cache.max - cache.min;
+                // if all of the values are the same, skip this sorting coefficient
+                if (range == 0.0)
+                    continue;
+
+                float normalizeRatio = 1 / range;
+                float weight = option.weight;
+                auto coeff = cache.coeffs;
+                // the compact form is already normalized
+                if (coeff == NULL) {
+                    const auto* __restrict__ qcoeff = cache.qcoeffs;
+                    const uint16_t flip = option.reverse ? 0xFFFF : 0;
+                    normalizeRatio = 1.0f / 65535;
+                    for (uint32_t i = begin; i < end; i++) {
+                        float val = (qcoeff[i] ^ flip) * normalizeRatio;
+                        coeffs[i] += weight * val * val;
+                    }
+                    continue;
+                }
+                // use Euclidean distance to combine multiple sorting coefficients
+                if (option.reverse) {
+                    for (uint32_t i = begin; i < end; i++) {
+                        float val = (cache.max - coeff[i]) * normalizeRatio;
+                        coeffs[i] += weight * val * val;
+                    }
+                } else {
+                    for (uint32_t i = begin; i < end; i++) {
+                        float val = (coeff[i] - cache.min) * normalizeRatio;
+                        coeffs[i] += weight * val * val;
+                    }
+                }
+            }
+        });
+        sortKeys[0] = {1.0f, coeffs};
+        numSortKeys = 1;
+    } else {
+        // if option[i] is reverse, ifReverse[i] will be -1 * weight
+        // cached array of coefficients for each enabled sort function
+        for (int i = 0; i < enabled; i++) {
+            int funcIdx = enabledOptions[i].idx;
+            sortKeys[i] = sortKeyOf(computeCoeffFor(funcIdx), enabledOptions[i].reverse);
+        }
+        numSortKeys = enabled;
+    }
+    hasPrevOrder = true;
+    // the order of the collapsed schedules is needed as a whole to locate the expanded ones (see `expandPrefix`)
+    if (!classRep.empty() && count >= RADIX_SORT_MIN) {
+        radixSort();
+        return;
+    }
+    withSortComparator([repair](auto cmpFunc) {
+        if (!classRep.empty()) {
+            std::sort(indices, indices + count, cmpFunc);
+        } else if (repair) {
+            repairSort(cmpFunc);
+        } else {
+            _apply_sort(cmpFunc);
+        }
+    });
 }
 
 void setSortMode(int mode) {
     sortMode = mode;
 }
 
+/**
+ * @param flags bitwise or of GenFlag values, used by subsequent calls of `generate`
+ */
+void setGenFlags(int flags) {
+    genFlags = flags;
+}
+
+/**
+ * set the number of threads used by the parallel routines. Has no effect unless compiled with USE_THREADS
+ */
+void setNumThreads(int n) {
+#ifdef USE_THREADS
+    numThreads = std::max(n, 1);
+#endif
+}
+
+/**
+ * limit the memory of the cached coefficient arrays of the sort functions to `bytes` (0 for no limit).
+ * When a sort needs new arrays, the least recently used arrays it does not need are freed to make room
+ */
+void setCoeffCacheBudget(uint32_t bytes) {
+    coeffCacheBudget = bytes;
+}
+
+/** set the seed of the random draws of GenFlag::sample, so that the same samples are drawn from the same schedules */
+void setRandomSeed(uint32_t seed) {
+    randomSeed = seed;
+}
+
+/**
+ * set the hard constraints applied by the following calls of `generate` (see `Constraints`).
+ * `countSchedules` only applies those on single sections. The next edit of the selection generates again, as the current schedules
+ * were filtered by the previous constraints
+ * @param freeDays bit d set if there must be no meeting on day d
+ * @param earliest no meeting may start before this time, in minutes since midnight
+ * @param latest no meeting may end after this time, in minutes since midnight
+ * @param maxDays the maximum number of days with meetings
+ * @param maxGap the maximum total length of the gaps between the meetings of each day, in minutes. -1 for no limit
+ */
+void setConstraints(int freeDays, int earliest, int latest, int maxDays, int maxGap) {
+    constraints.freeDays = freeDays;
+    constraints.earliest = earliest;
+    constraints.latest = latest;
+    constraints.maxDays = maxDays;
+    constraints.maxGap = maxGap;
+    selection.editable = false;
+}
+
 void setSortOption(int i, int enabled, int reverse, int idx, float weight) {
     sortOptions[i] = {(bool)enabled, (bool)reverse, idx, weight};
 }
@@ -568,13 +4252,51 @@ void setTimeMatrix(int* ptr, int sideLen) {
 }
 
 int size() {
-    return count;
+    return std::min<uint64_t>(expandedCount, std::numeric_limits<int>::max());
+}
+
+/** fill `expandPrefix` from the current order of `indices`, unless it is already filled */
+void buildExpandPrefix() {
+    if (!expandPrefix.empty()) return;
+    static vector<uint16_t> row;
+    row.resize(numCourses);
+    expandPrefix.resize(count + 1);
+    expandPrefix[0] = 0;
+    for (uint32_t p = 0; p < count; p++)
+        expandPrefix[p + 1] = addSat(expandPrefix[p], numExpansions(rowOf(indices[p], row.data())));
 }
 
 uint16_t* getSchedule(int idx) {
+    static vector<uint16_t> row;
+    row.resize(numCourses);
+    if (!classRep.empty()) {
+        buildExpandPrefix();
+        const int p = std::upper_bound(expandPrefix.begin(), expandPrefix.end(), (uint64_t)idx) - expandPrefix.begin() - 1;
+        const auto* src = rowOf(indices[p], row.data());
+        if (src != row.data()) memcpy(row.data(), src, numCourses * sizeof(uint16_t));
+        expandSchedule(idx - expandPrefix[p], row.data());
+        return row.data();
+    }
+    if (!paretoLayers.empty()) peelLayers(idx);
+    if (!sortedPages.empty() && !sortedPages[idx / SORT_PAGE_SIZE]) orderPage(idx / SORT_PAGE_SIZE);
+    if (!factors.empty() || packed) return (uint16_t*)rowOf(indices[idx], row.data());
     return schedules + indices[idx] * numCourses;
 }
 
+/**
+ * @returns the index of the first schedule of the layer-th Pareto layer of the last sort (SortMode::pareto),
+ * or the number of schedules if there are fewer layers. The layers up to that one are found if they are not yet,
+ * so that the schedules can be paged by layer. In the other modes, all schedules are in the first layer
+ */
+int getLayerStart(int layer) {
+    if (paretoLayers.empty()) return layer > 0 ? size() : 0;
+    while ((int)paretoLayers.size() <= layer && paretoLayers.back() < count) peelLayer();
+    if (layer >= (int)paretoLayers.size()) return size();
+    if (classRep.empty()) return paretoLayers[layer];
+    buildExpandPrefix();
+    return std::min<uint64_t>(expandPrefix[paretoLayers[layer]], std::numeric_limits<int>::max());
+}
+
 float getRange(int idx) {
     return sortCoeffCache[idx].max - sortCoeffCache[idx].min;
 }
@@ -584,15 +4306,659 @@ void setRefSchedule(uint16_t* ref) {
     if (refSchedule != NULL) free((void*)refSchedule);
     refSchedule = ref;
     auto& cache = sortCoeffCache[5];
-    if (cache.coeffs != NULL) {
-        delete[] cache.coeffs;
-        cache.coeffs = NULL;
+    if (cache.computed()) {
+        // the pages not ordered yet can no longer be ordered by similarity, so they stay unordered until the next sort.
+        // Likewise, the schedules not in a Pareto layer yet are left in one last unordered layer
+        for (int i = 0; i < numSortKeys; i++) {
+            if (sortKeys[i].coeffs != cache.coeffs || sortKeys[i].qcoeffs != cache.qcoeffs) continue;
+            sortedPages.clear();
+            if (!paretoLayers.empty() && paretoLayers.back() < count) paretoLayers.push_back(count);
+        }
+        releaseCache(cache);
     }
 }
 }
 
 }  // namespace ScheduleGenerator
 #ifdef _TEST
+namespace Test {
+using namespace ScheduleGenerator;
+
+/** the number of failed checks */
+int failures = 0;
+
+void check(bool ok, const string& what) {
+    if (ok) return;
+    failures++;
+    cout << "FAILED: " << what << endl;
+}
+
+/** a random selection of courses, in the format of `generate` */
+struct Instance {
+    int numCourses;
+    vector<int> sectionLens;
+    vector<uint16_t> timeArray;
+    /** the first and the last date of section i at 2i and 2i + 1 */
+    vector<double> dateRanges;
+    vector<uint8_t> conflicts;
+};
+
+/**
+ * @param maxSections the maximum number of sections of each course
+ * @param splitDates whether some sections only meet in the first half of the semester and some only in the second half,
+ * so that they do not conflict even if they meet at the same time
+ * @note the rooms are 0, 1 and 2, for a time matrix of side 3
+ */
+Instance randomInstance(mt19937& rng, int numCourses, int maxSections, bool splitDates = false) {
+    Instance inst;
+    inst.numCourses = numCourses;
+    inst.sectionLens = {0};
+    for (int c = 0; c < numCourses; c++) inst.sectionLens.push_back(inst.sectionLens.back() + 1 + rng() % maxSections);
+    const int n = inst.sectionLens.back();
+    vector<vector<array<uint16_t, 3>>> days(n * 7);
+    for (int i = 0; i < n; i++) {
+        // the meetings of a section are on different days, so they do not overlap
+        int weekDays[] = {0, 1, 2, 3, 4};
+        std::shuffle(weekDays, weekDays + 5, rng);
+        for (int k = 1 + rng() % 3; k > 0; k--) {
+            const int start = 480 + 10 * (rng() % 60), length[] = {50, 75, 110};
+            days[i * 7 + weekDays[k]].push_back({(uint16_t)start, (uint16_t)(start + length[rng() % 3]), (uint16_t)(rng() % 3)});
+        }
+        const int half = splitDates ? rng() % 3 : 2;
+        inst.dateRanges.push_back(half == 1 ? 51 : 0);
+        inst.dateRanges.push_back(half == 0 ? 50 : 100);
+    }
+    inst.timeArray.resize(n * 8);
+    vector<uint16_t> content;
+    for (int i = 0; i < n; i++) {
+        for (int d = 0; d < 7; d++) {
+            inst.timeArray[i * 8 + d] = content.size();
+            auto& meetings = days[i * 7 + d];
+            std::sort(meetings.begin(), meetings.end());
+            for (const auto& m : meetings) content.insert(content.end(), m.begin(), m.end());
+        }
+        inst.timeArray[i * 8 + 7] = content.size();
+    }
+    inst.timeArray.insert(inst.timeArray.end(), content.begin(), content.end());
+    inst.conflicts.assign(n * n, 0);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (i == j || inst.dateRanges[2 * i] > inst.dateRanges[2 * j + 1] || inst.dateRanges[2 * j] > inst.dateRanges[2 * i + 1])
+                continue;
+            for (int d = 0; d < 7; d++) {
+                for (const auto& a : days[i * 7 + d]) {
+                    for (const auto& b : days[j * 7 + d]) inst.conflicts[i * n + j] |= calcOverlap<int>(a[0], a[1], b[0], b[1]) > 0;
+                }
+            }
+        }
+    }
+    return inst;
+}
+
+/** @returns the number of schedules generated from inst with `flags` */
+int generateWith(Instance& inst, int flags, int maxNumSchedules) {
+    setGenFlags(flags);
+    const int result = generate(inst.numCourses, maxNumSchedules, inst.sectionLens.data(), inst.conflicts.data(), inst.timeArray.data());
+    setGenFlags(0);
+    return result;
+}
+
+/** @returns the schedules in the order of `getSchedule` */
+vector<vector<uint16_t>> scheduleRows() {
+    vector<vector<uint16_t>> rows;
+    for (int i = 0; i < size(); i++) rows.emplace_back(getSchedule(i), getSchedule(i) + numCourses);
+    return rows;
+}
+
+/**
+ * @returns the coefficients of the schedules for `options` (see `setSortOptions`), in the order of `getSchedule`.
+ * Unlike the rows, they do not depend on how ties are broken
+ */
+vector<vector<float>> sortKeyRows(const vector<pair<int, bool>>& options) {
+    vector<vector<float>> rows(size());
+    for (int i = 0; i < size(); i++) {
+        for (const auto& option : options) rows[i].push_back(sortCoeffCache[option.first].coeffs[indices[i]]);
+    }
+    return rows;
+}
+
+/** @returns the schedules in increasing order */
+vector<vector<uint16_t>> scheduleSet() {
+    sort();
+    auto rows = scheduleRows();
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+/** disable all sort options, then enable options[i] = {idx, reverse} by priority */
+void setSortOptions(const vector<pair<int, bool>>& options) {
+    for (int i = 0; i < NUM_SORT_FUNCS; i++) setSortOption(i, 0, 0, i, 1);
+    for (int i = 0; i < (int)options.size(); i++) setSortOption(i, 1, options[i].second, options[i].first, 1);
+}
+
+/** every combination of the search flags generates the same schedules as the plain DFS, with random constraints */
+void testFlags(mt19937& rng) {
+    const int flags[] = {GenFlag::forwardCheck, GenFlag::parallel,  GenFlag::dynamicOrder, GenFlag::backjump,     GenFlag::factorize,
+                         GenFlag::collapse,     GenFlag::pack,      GenFlag::lazyBlocks,   GenFlag::compactCoeffs};
+    for (int it = 0; it < 300; it++) {
+        auto inst = randomInstance(rng, 2 + rng() % 5, 6, it % 2);
+        // some sections share their time arrays, so that GenFlag::collapse has classes
+        for (int c = 0; c < inst.numCourses; c++) {
+            const int begin = inst.sectionLens[c], end = inst.sectionLens[c + 1], n = inst.sectionLens.back();
+            for (int s = begin + 1; s < end; s++) {
+                if (rng() % 3) continue;
+                for (int d = 0; d < 8; d++) inst.timeArray[s * 8 + d] = inst.timeArray[(s - 1) * 8 + d];
+                inst.dateRanges[2 * s] = inst.dateRanges[2 * s - 2];
+                inst.dateRanges[2 * s + 1] = inst.dateRanges[2 * s - 1];
+                for (int j = 0; j < n; j++) {
+                    inst.conflicts[s * n + j] = j != s && inst.conflicts[(s - 1) * n + j];
+                    inst.conflicts[j * n + s] = j != s && inst.conflicts[j * n + s - 1];
+                }
+            }
+        }
+        if (it % 3 == 0) setConstraints(rng() % 2 ? 1 << rng() % 5 : 0, 0, rng() % 2 ? 1080 : 24 * 60, 3 + rng() % 3, -1);
+        if (it % 3 == 1) setConstraints(0, rng() % 2 ? 540 : 0, 24 * 60, 7, 60 * (rng() % 4));
+        generateWith(inst, 0, 1 << 20);
+        const auto expected = scheduleSet();
+        int mask = 0;
+        for (int f : flags) {
+            if (rng() % 2) mask |= f;
+        }
+        generateWith(inst, mask, 1 << 20);
+        check(scheduleSet() == expected, "flags " + to_string(mask) + " == the plain DFS (it " + to_string(it) + ")");
+        setConstraints(0, 0, 24 * 60, 7, -1);
+    }
+}
+
+/** `countSchedules` counts the schedules generated by the plain DFS, with random constraints on single sections */
+void testCount(mt19937& rng) {
+    for (int it = 0; it < 300; it++) {
+        // at most 8^7 = 2^21 schedules
+        auto inst = randomInstance(rng, 1 + rng() % 7, 8, it % 2);
+        if (it % 3 == 0) setConstraints(rng() % 2 ? 1 << rng() % 5 : 0, rng() % 2 ? 540 : 0, rng() % 2 ? 1080 : 24 * 60, 7, -1);
+        const double counted = countSchedules(inst.numCourses, inst.sectionLens.data(), inst.conflicts.data(), inst.timeArray.data());
+        generateWith(inst, 0, 1 << 21);
+        check(counted == size(), "countSchedules == size (it " + to_string(it) + ")");
+        setConstraints(0, 0, 24 * 60, 7, -1);
+    }
+}
+
+/**
+ * the samples of GenFlag::sample are distinct schedules of the plain DFS, as many as requested unless there are fewer,
+ * with random constraints
+ */
+void testSample(mt19937& rng) {
+    for (int it = 0; it < 300; it++) {
+        auto inst = randomInstance(rng, 2 + rng() % 5, 8, it % 2);
+        if (it % 3 == 0) setConstraints(rng() % 2 ? 1 << rng() % 5 : 0, 0, 24 * 60, 3 + rng() % 3, rng() % 2 ? 120 : -1);
+        generateWith(inst, 0, 1 << 20);
+        const auto all = scheduleSet();
+        const int K = 1 + rng() % std::max<int>(2 * all.size(), 1);
+        setRandomSeed(it);
+        generateWith(inst, GenFlag::sample, K);
+        const auto samples = scheduleSet();
+        check(samples.size() == std::min<size_t>(K, all.size()) &&
+                  std::adjacent_find(samples.begin(), samples.end()) == samples.end() &&
+                  std::includes(all.begin(), all.end(), samples.begin(), samples.end()),
+              "samples are distinct schedules (it " + to_string(it) + ")");
+        setConstraints(0, 0, 24 * 60, 7, -1);
+    }
+    // when the draws are given up, each schedule satisfying the constraints is kept with the same probability
+    for (int it = 0; it < 10; it++) {
+        Instance inst;
+        vector<vector<uint16_t>> all;
+        do {
+            inst = randomInstance(rng, 3 + rng() % 3, 6, it % 2);
+            setConstraints(it % 2 ? 1 << rng() % 5 : 0, 0, 24 * 60, 3 + rng() % 3, it % 3 ? 120 : -1);
+            all.resize(generateWith(inst, 0, 1 << 20));
+            for (int i = 0; i < (int)all.size(); i++) all[i].assign(schedules + i * inst.numCourses, schedules + (i + 1) * inst.numCourses);
+        } while (all.size() < 6);
+        const uint32_t K = all.size() / 3;
+        // packs the conflicts and sizes the rows for reservoirSample
+        generateWith(inst, GenFlag::sample, K);
+        constexpr int T = 400;
+        vector<int> hits(all.size());
+        bool valid = true;
+        for (int t = 0; t < T && valid; t++) {
+            std::mt19937_64 eng(t);
+            valid = reservoirSample(inst.numCourses, K, inst.sectionLens.data(), eng) == (int)K;
+            // distinct schedules in the order of generate, which sorts the rows
+            for (int r = 0, last = -1; r < (int)K && valid; r++) {
+                const vector<uint16_t> row(schedules + r * inst.numCourses, schedules + (r + 1) * inst.numCourses);
+                const int pos = std::lower_bound(all.begin(), all.end(), row) - all.begin();
+                valid = pos < (int)all.size() && all[pos] == row && pos > last;
+                if (valid) hits[last = pos]++;
+            }
+        }
+        const double p = (double)K / all.size(), sigma = std::sqrt(T * p * (1 - p));
+        for (int h : hits) valid &= std::abs(h - T * p) < 5 * sigma;
+        check(valid, "reservoir samples are uniform (it " + to_string(it) + ")");
+        setConstraints(0, 0, 24 * 60, 7, -1);
+    }
+}
+
+/** the K best schedules kept by GenFlag::topK are the first K schedules of a full sort */
+void testTopK(mt19937& rng) {
+    auto* matrix = (int*)malloc(9 * sizeof(int));
+    for (int i = 0; i < 9; i++) matrix[i] = rng() % 10;
+    setTimeMatrix(matrix, 3);
+    setSortMode(SortMode::fallback);
+    for (int it = 0; it < 300; it++) {
+        // sections meeting at the same time on disjoint dates make the bounds of compactness and distance fail
+        auto inst = randomInstance(rng, 3 + rng() % 3, 6, it % 2);
+        // compactness or distance first, as their bounds prune the most
+        vector<pair<int, bool>> options = {{rng() % 2 ? 0 : 2, false}};
+        for (int f : {0, 2, 3, 4}) {
+            if (f != options[0].first && rng() % 2) options.push_back({f, f != 4 && rng() % 4 == 0});
+        }
+        std::shuffle(options.begin() + 1, options.end(), rng);
+        setSortOptions(options);
+        const int K = 1 + rng() % 20;
+        generateWith(inst, 0, 1 << 20);
+        sort();
+        auto all = sortKeyRows(options);
+        all.resize(std::min<size_t>(all.size(), K));
+        generateWith(inst, GenFlag::topK, K);
+        sort();
+        check(sortKeyRows(options) == all, "topK == the first K schedules of a full sort (it " + to_string(it) + ")");
+    }
+    // the combined score normalizes by the range over all schedules, so the schedules kept are compared as sets:
+    // the final sort normalizes by the range over those kept only
+    setSortMode(SortMode::combined);
+    for (int it = 0; it < 300; it++) {
+        auto inst = randomInstance(rng, 3 + rng() % 3, 6, it % 2);
+        vector<int> funcs = {0, 1, 2, 3, 4};
+        std::shuffle(funcs.begin(), funcs.end(), rng);
+        funcs.resize(2 + rng() % 3);
+        for (int i = 0; i < NUM_SORT_FUNCS; i++) setSortOption(i, 0, 0, i, 1);
+        for (int i = 0; i < (int)funcs.size(); i++) setSortOption(i, 1, rng() % 4 == 0, funcs[i], 1 + rng() % 4);
+        const int K = 1 + rng() % 20;
+        generateWith(inst, 0, 1 << 20);
+        sort();
+        auto all = scheduleRows();
+        all.resize(std::min<size_t>(all.size(), K));
+        std::sort(all.begin(), all.end());
+        generateWith(inst, GenFlag::topK, K);
+        check(scheduleSet() == all, "combined topK == the first K schedules of a full sort (it " + to_string(it) + ")");
+    }
+    setSortMode(SortMode::fallback);
+    setSortOptions({});
+    setTimeMatrix(NULL, 0);
+}
+
+/** scanning the pages of a sort in order, then at random, gives a complete order by the comparator of the sort */
+void testPages(mt19937& rng) {
+    setSortMode(SortMode::fallback);
+    for (int it = 0; it < 20; it++) {
+        Instance inst;
+        do {
+            // every combination is a schedule, as only the order matters here
+            inst = randomInstance(rng, 6, 8);
+            std::fill(inst.conflicts.begin(), inst.conflicts.end(), 0);
+        } while (generateWith(inst, 0, 1 << 20) < (int)RADIX_SORT_MIN * 2);
+        // the keys have many ties, broken by the index
+        setSortOptions({{3, it % 2}, {4, false}, {1, true}});
+        sort();
+        vector<int> expected(ScheduleGenerator::count);
+        for (uint32_t i = 0; i < ScheduleGenerator::count; i++) expected[i] = i;
+        withSortComparator([&](auto cmpFunc) { std::sort(expected.begin(), expected.end(), cmpFunc); });
+        const uint32_t numPages = (ScheduleGenerator::count + SORT_PAGE_SIZE - 1) / SORT_PAGE_SIZE;
+        if (it % 2) {
+            for (uint32_t p = 0; p < numPages; p++) getSchedule(p * SORT_PAGE_SIZE);
+        } else {
+            for (int k = 0; k < 5; k++) getSchedule(rng() % ScheduleGenerator::count);
+        }
+        for (uint32_t p = 0; p < numPages; p++) getSchedule(rng() % ScheduleGenerator::count);
+        for (uint32_t p = 0; p < numPages; p++) getSchedule(p * SORT_PAGE_SIZE);
+        check(std::equal(expected.begin(), expected.end(), indices), "pages == a complete sort (it " + to_string(it) + ")");
+    }
+    setSortOptions({});
+}
+
+/** a sort that starts from the previous order gives the same pages as a sort from scratch */
+void testResort(mt19937& rng) {
+    for (int it = 0; it < 20; it++) {
+        Instance inst;
+        do {
+            inst = randomInstance(rng, 6, 8);
+            std::fill(inst.conflicts.begin(), inst.conflicts.end(), 0);
+        } while (generateWith(inst, 0, 1 << 20) < (int)SORT_PAGE_SIZE * 3);
+        for (int step = 0; step < 6; step++) {
+            setSortMode(rng() % 2 ? SortMode::combined : SortMode::fallback);
+            for (int i = 0; i < NUM_SORT_FUNCS; i++) setSortOption(i, 0, 0, i, 1);
+            int enabled = 0;
+            for (int f : {1, 3, 4}) {
+                if (rng() % 3) setSortOption(enabled++, 1, rng() % 2, f, 1 + rng() % 4);
+            }
+            sort();
+            const uint32_t pages[] = {0, 1, (uint32_t)(rng() % ScheduleGenerator::count / SORT_PAGE_SIZE)};
+            vector<vector<uint16_t>> rows;
+            for (uint32_t p : pages) rows.emplace_back(getSchedule(p * SORT_PAGE_SIZE), getSchedule(p * SORT_PAGE_SIZE) + numCourses);
+            hasPrevOrder = false;
+            sort();
+            for (int k = 0; k < 3; k++) {
+                const auto* row = getSchedule(pages[k] * SORT_PAGE_SIZE);
+                check(std::equal(row, row + numCourses, rows[k].begin()), "re-sort == sort (it " + to_string(it) + ")");
+            }
+        }
+    }
+    setSortOptions({});
+    setSortMode(SortMode::fallback);
+}
+
+/**
+ * generating in steps (see `generateStep`) gives the same schedules in the same order as `generate`,
+ * with random budgets and sorts between the steps
+ */
+void testSteps(mt19937& rng) {
+    for (int it = 0; it < 200; it++) {
+        auto inst = randomInstance(rng, 2 + rng() % 5, 6, it % 2);
+        if (it % 3 == 0) setConstraints(rng() % 2 ? 1 << rng() % 5 : 0, 0, 24 * 60, 3 + rng() % 3, rng() % 2 ? 120 : -1);
+        const int flags = rng() % 2 ? GenFlag::lazyBlocks : 0;
+        const int maxN = rng() % 2 ? 1 << 20 : 1 + rng() % 50;
+        const int total = generateWith(inst, flags, maxN);
+        const vector<uint16_t> all(schedules, schedules + total * inst.numCourses);
+        const vector<pair<int, bool>> options = {{1 + rng() % 4, rng() % 2 != 0}};
+        setSortOptions(options);
+        sort();
+        const auto sorted = sortKeyRows(options);
+
+        setGenFlags(flags);
+        startGenerate(inst.numCourses, maxN, inst.sectionLens.data(), inst.conflicts.data(), inst.timeArray.data());
+        bool valid = true;
+        int result;
+        while ((result = generateStep(1 + rng() % 64)) == 0 && valid) {
+            // the schedules found so far are the first ones of generate
+            const uint32_t found = ScheduleGenerator::count;
+            valid = found <= (uint32_t)total && std::equal(schedules, schedules + found * inst.numCourses, all.begin());
+            if (rng() % 3) continue;
+            setSortMode(rng() % 3);
+            setSortOptions({{1 + rng() % 4, rng() % 2 != 0}});
+            sort();
+            valid &= size() == (int)found;
+            if (found) getSchedule(rng() % found);
+        }
+        setGenFlags(0);
+        setSortMode(SortMode::fallback);
+        setSortOptions(options);
+        valid &= result == 1 && ScheduleGenerator::count == (uint32_t)total &&
+                 std::equal(all.begin(), all.end(), schedules);
+        sort();
+        valid &= sortKeyRows(options) == sorted;
+        check(valid, "generateStep == generate (it " + to_string(it) + ")");
+        setConstraints(0, 0, 24 * 60, 7, -1);
+    }
+    setSortOptions({});
+}
+
+/**
+ * load a catalog (see `loadCatalog`) with the sections of inst at numOthers and after,
+ * after numOthers other sections that meet three times a week
+ */
+void loadInstance(mt19937& rng, const Instance& inst, int numOthers) {
+    const int n = inst.sectionLens.back(), numSections = numOthers + n;
+    vector<uint32_t> offsets(numSections * 8);
+    vector<uint16_t> content;
+    for (int i = 0; i < numSections; i++) {
+        for (int d = 0; d < 8; d++) {
+            offsets[i * 8 + d] = content.size();
+            if (d == 7) break;
+            if (i >= numOthers) {
+                const int k = i - numOthers;
+                content.insert(content.end(), inst.timeArray.begin() + n * 8 + inst.timeArray[k * 8 + d],
+                               inst.timeArray.begin() + n * 8 + inst.timeArray[k * 8 + d + 1]);
+            } else if (d % 2 == 0 && d < 6) {
+                const uint16_t start = 480 + 10 * (rng() % 60);
+                content.insert(content.end(), {start, (uint16_t)(start + 50), (uint16_t)(rng() % 3)});
+            }
+        }
+    }
+    auto* timeArray = (uint32_t*)malloc(offsets.size() * sizeof(uint32_t) + content.size() * sizeof(uint16_t) + 1);
+    std::copy(offsets.begin(), offsets.end(), timeArray);
+    std::copy(content.begin(), content.end(), (uint16_t*)(timeArray + offsets.size()));
+    auto* dateRanges = (double*)malloc(numSections * 2 * sizeof(double));
+    for (int i = 0; i < numSections; i++) {
+        dateRanges[2 * i] = i < numOthers ? 0 : inst.dateRanges[2 * (i - numOthers)];
+        dateRanges[2 * i + 1] = i < numOthers ? 100 : inst.dateRanges[2 * (i - numOthers) + 1];
+    }
+    loadCatalog(numSections, timeArray, dateRanges);
+}
+
+/** the sweep of buildConflictCache finds the same conflicts as comparing every pair of meetings */
+void testConflictCache(mt19937& rng) {
+    for (int it = 0; it < 100; it++) {
+        auto inst = randomInstance(rng, 2 + rng() % 6, 8, it % 2);
+        const int n = inst.sectionLens.back();
+        vector<uint8_t> conflicts(n * n, 2);
+        buildConflictCache(n, inst.timeArray.data(), inst.dateRanges.data(), conflicts.data());
+        check(conflicts == inst.conflicts, "buildConflictCache == pairwise conflicts (it " + to_string(it) + ")");
+    }
+}
+
+/**
+ * schedules generated from a catalog whose time arrays are longer than 65535 are the same as those generated
+ * from the time arrays and the conflicts of the selected sections
+ */
+void testLargeCatalog(mt19937& rng) {
+    for (int it = 0; it < 5; it++) {
+        auto inst = randomInstance(rng, 3 + rng() % 3, 6, it % 2);
+        const int n = inst.sectionLens.back(), numOthers = 8000;
+        loadInstance(rng, inst, numOthers);
+        check(catalog.offsets[(numOthers + n) * 8 - 1] > 0xFFFF, "the catalog is longer than 65535");
+
+        generateWith(inst, 0, 1 << 20);
+        sort();
+        const auto expected = scheduleRows();
+        vector<int> sectionIds(n);
+        for (int i = 0; i < n; i++) sectionIds[i] = numOthers + i;
+        generateFromCatalog(inst.numCourses, 1 << 20, inst.sectionLens.data(), sectionIds.data());
+        sort();
+        check(scheduleRows() == expected, "generateFromCatalog == generate (it " + to_string(it) + ")");
+    }
+}
+
+/** the schedules after each edit of the selection are the same as those generated from scratch, with random constraints */
+void testEdits(mt19937& rng) {
+    // a course filling a gap (maxGap) is rare, hence many instances
+    for (int it = 0; it < 2000; it++) {
+        auto inst = randomInstance(rng, 6, 5, it % 2);
+        loadInstance(rng, inst, 0);
+        const bool constrained = it % 4 != 0;
+        setConstraints(constrained && rng() % 2 ? 1 << rng() % 5 : 0, constrained && rng() % 2 ? 540 : 0,
+                       constrained && rng() % 2 ? 1080 : 24 * 60, constrained && rng() % 2 ? 3 + rng() % 2 : 7,
+                       constrained && rng() % 2 ? 60 * (rng() % 4) : -1);
+        // the courses of the catalog in the selection, and whether each section is selected
+        vector<int> courses;
+        vector<bool> selected(inst.sectionLens.back());
+        auto courseSections = [&](int course) {
+            vector<int> ids;
+            for (int s = inst.sectionLens[course]; s < inst.sectionLens[course + 1]; s++) {
+                if (rng() % 4) ids.push_back(s);
+            }
+            if (ids.empty()) ids.push_back(inst.sectionLens[course]);
+            for (int s : ids) selected[s] = true;
+            return ids;
+        };
+        vector<int> sectionLens = {0}, sectionIds;
+        for (int course = 0; course < 2; course++) {
+            auto ids = courseSections(course);
+            sectionIds.insert(sectionIds.end(), ids.begin(), ids.end());
+            sectionLens.push_back(sectionIds.size());
+            courses.push_back(course);
+        }
+        setGenFlags(it % 3 ? 0 : GenFlag::forwardCheck);
+        generateFromCatalog(2, 1 << 20, sectionLens.data(), sectionIds.data());
+        for (int step = 0; step < 8; step++) {
+            const int c = rng() % courses.size(), course = courses[c];
+            const int kind = rng() % 4;
+            string edit;
+            if (kind == 0 && courses.size() < 6) {
+                int next = 0;
+                while (std::find(courses.begin(), courses.end(), next) != courses.end()) next++;
+                auto ids = courseSections(next);
+                addCourse(ids.size(), ids.data());
+                courses.push_back(next);
+                edit = "addCourse";
+            } else if (kind == 1) {
+                for (int s = inst.sectionLens[course]; s < inst.sectionLens[course + 1]; s++) {
+                    if (selected[s]) continue;
+                    selected[s] = true;
+                    addSection(c, s);
+                    break;
+                }
+                edit = "addSection";
+            } else if (kind == 2 && selection.sectionLens[c + 1] - selection.sectionLens[c] > 1) {
+                const int s = selection.sectionIds[selection.sectionLens[c] + rng() % (selection.sectionLens[c + 1] - selection.sectionLens[c])];
+                selected[s] = false;
+                removeSection(c, s);
+                edit = "removeSection";
+            } else if (kind == 3 && courses.size() > 1) {
+                for (int s = inst.sectionLens[course]; s < inst.sectionLens[course + 1]; s++) selected[s] = false;
+                courses.erase(courses.begin() + c);
+                removeCourse(c);
+                edit = "removeCourse";
+            } else {
+                continue;
+            }
+            const auto edited = scheduleSet();
+            regenerate();
+            check(edited == scheduleSet(), edit + " == regenerate (it " + to_string(it) + ", step " + to_string(step) + ")");
+        }
+        setGenFlags(0);
+    }
+    // an edit after the constraints change cannot keep the schedules filtered by the previous ones
+    for (int it = 0; it < 50; it++) {
+        auto inst = randomInstance(rng, 4, 5, it % 2);
+        loadInstance(rng, inst, 0);
+        vector<int> sectionLens = {0}, sectionIds;
+        for (int c = 0; c < inst.numCourses; c++) {
+            // leave out the last section of the first course, to be added
+            for (int s = inst.sectionLens[c]; s < inst.sectionLens[c + 1] - (c == 0); s++) sectionIds.push_back(s);
+            sectionLens.push_back(sectionIds.size());
+        }
+        if (sectionLens[1] == 0) continue;
+        setConstraints(0, 0, 24 * 60, 2, -1);
+        generateFromCatalog(inst.numCourses, 1 << 20, sectionLens.data(), sectionIds.data());
+        setConstraints(0, 0, 24 * 60, 7, -1);
+        addSection(0, inst.sectionLens[1] - 1);
+        const auto edited = scheduleSet();
+        regenerate();
+        check(edited == scheduleSet(), "addSection after setConstraints == regenerate (it " + to_string(it) + ")");
+    }
+    // an added section whose schedules reach the maximum cannot keep the first ones of generate by appending them
+    for (int it = 0; it < 50; it++) {
+        auto inst = randomInstance(rng, 4, 5, it % 2);
+        loadInstance(rng, inst, 0);
+        vector<int> sectionLens = {0}, sectionIds;
+        for (int c = 0; c < inst.numCourses; c++) {
+            // leave out the first section of the last course, to be added
+            for (int s = inst.sectionLens[c] + (c + 1 == inst.numCourses); s < inst.sectionLens[c + 1]; s++) sectionIds.push_back(s);
+            sectionLens.push_back(sectionIds.size());
+        }
+        const int last = inst.numCourses - 1;
+        if (sectionLens[last] == sectionLens[last + 1]) continue;
+        const int before = generateFromCatalog(inst.numCourses, 1 << 20, sectionLens.data(), sectionIds.data());
+        sectionIds.insert(sectionIds.begin() + sectionLens[last], inst.sectionLens[last]);
+        sectionLens.back()++;
+        const int after = generateFromCatalog(inst.numCourses, 1 << 20, sectionLens.data(), sectionIds.data());
+        if (after < before + 2) continue;
+        // the added schedules reach the maximum, and they are interleaved with the current ones in the order of generate
+        sectionIds.erase(sectionIds.begin() + sectionLens[last]);
+        sectionLens.back()--;
+        generateFromCatalog(inst.numCourses, before + 1 + rng() % (after - before - 1), sectionLens.data(), sectionIds.data());
+        addSection(last, inst.sectionLens[last]);
+        const auto edited = scheduleSet();
+        regenerate();
+        check(edited == scheduleSet(), "addSection up to the maximum == regenerate (it " + to_string(it) + ")");
+    }
+    setConstraints(0, 0, 24 * 60, 7, -1);
+}
+
+/**
+ * each Pareto layer holds the schedules not dominated by the schedules of the same or later layers,
+ * and each of them is dominated by some schedule of the previous layer
+ */
+void testPareto(mt19937& rng) {
+    setSortMode(SortMode::pareto);
+    for (int it = 0; it < 30; it++) {
+        Instance inst;
+        do {
+            inst = randomInstance(rng, 4, 6);
+            std::fill(inst.conflicts.begin(), inst.conflicts.end(), 0);
+        } while (generateWith(inst, it % 2 ? GenFlag::compactCoeffs : 0, 1 << 20) < 100);
+        auto* ref = (uint16_t*)malloc(inst.numCourses * sizeof(uint16_t));
+        for (int c = 0; c < inst.numCourses; c++) ref[c] = inst.sectionLens[c];
+        setRefSchedule(ref);
+        vector<pair<int, bool>> options;
+        for (int f : {1, 3, 4, 5}) {
+            if (rng() % 2) options.push_back({f, rng() % 2});
+        }
+        if (options.empty()) options.push_back({3, false});
+        setSortOptions(options);
+        sort();
+        const bool similarity = std::find_if(options.begin(), options.end(), [](auto& o) { return o.first == 5; }) != options.end();
+        // without the coefficients of similarity, the schedules not in a layer yet are left in a last layer
+        if (similarity && it % 3 == 0) {
+            ref = (uint16_t*)malloc(inst.numCourses * sizeof(uint16_t));
+            std::fill_n(ref, inst.numCourses, 0);
+            setRefSchedule(ref);
+        }
+        getSchedule(ScheduleGenerator::count - 1);
+        check(paretoLayers.back() == ScheduleGenerator::count, "the layers hold all schedules (it " + to_string(it) + ")");
+        if (similarity && it % 3 == 0) {
+            // the layers are checked with the new coefficients
+            sort();
+            getSchedule(ScheduleGenerator::count - 1);
+        }
+        // the coefficients of the schedule at position p, negated if reversed
+        auto keysAt = [&](uint32_t p) {
+            vector<float> keys;
+            for (const auto& [f, reverse] : options) {
+                const auto& cache = sortCoeffCache[f];
+                const float val = cache.coeffs != NULL ? cache.coeffs[indices[p]] : cache.qcoeffs[indices[p]];
+                keys.push_back(reverse ? -val : val);
+            }
+            return keys;
+        };
+        auto dominated = [&](uint32_t p, uint32_t begin, uint32_t end) {
+            const auto keys = keysAt(p);
+            for (uint32_t q = begin; q < end; q++) {
+                const auto other = keysAt(q);
+                if (std::equal(other.begin(), other.end(), keys.begin(), std::less_equal<float>()) && other != keys) return true;
+            }
+            return false;
+        };
+        bool valid = true;
+        for (size_t l = 0; l + 1 < paretoLayers.size() && valid; l++) {
+            for (uint32_t p = paretoLayers[l]; p < paretoLayers[l + 1] && valid; p++) {
+                valid = !dominated(p, paretoLayers[l], ScheduleGenerator::count) && (l == 0 || dominated(p, paretoLayers[l - 1], paretoLayers[l]));
+            }
+        }
+        check(valid, "Pareto layers (it " + to_string(it) + ")");
+    }
+    setRefSchedule(NULL);
+    setSortOptions({});
+    setSortMode(SortMode::fallback);
+}
+
+int run() {
+    mt19937 rng(1);
+    testFlags(rng);
+    testCount(rng);
+    testSample(rng);
+    testTopK(rng);
+    testPages(rng);
+    testResort(rng);
+    testSteps(rng);
+    testConflictCache(rng);
+    testLargeCatalog(rng);
+    testEdits(rng);
+    testPareto(rng);
+    cout << (failures ? to_string(failures) + " checks failed" : "all checks passed") << endl;
+    return failures != 0;
+}
+}  // namespace Test
+
 int main() {
     using namespace ScheduleGenerator;
     uint16_t timeArray[] = {
@@ -625,5 +4991,6 @@ int main() {
         /* code */
     }
     cout << endl;
+    return Test::run();
 }
 #endif
\ No newline at end of file
@@ -71,50 +71,73 @@ export function checkTimeConflict(
 /**
  * returns an array with all time arrays in `timeArrayList` concatenated together. The offsets
  * of time array of section `i` at day k is at `i * 8 + k` position of the resulting array.
+ * The offsets are 32-bit, as the time arrays of a whole catalog are longer than 65535,
+ * and they are followed by the 16-bit content (see `loadCatalog` in ScheduleGenerator.cpp)
  */
 function timeArrayToCompact(Module: EMModule, timeArrays: TimeArray[]) {
     const numSections = timeArrays.length;
     const prefixLen = numSections * 8;
-    let len = prefixLen;
+    let len = 0;
     for (const sec of timeArrays) {
         for (const day of sec) {
             len += day.length;
         }
     }
-    const ptr = Module._malloc(len * 2);
-    const arr = Module.HEAPU16.subarray(ptr / 2);
+    const ptr = Module._malloc(prefixLen * 4 + len * 2);
+    const offsets = Module.HEAPU32.subarray(ptr / 4, ptr / 4 + prefixLen);
+    const content = Module.HEAPU16.subarray((ptr + prefixLen * 4) / 2);
     len = 0;
     for (let i = 0; i < numSections; i++) {
         for (let k = 0; k < 7; k++) {
-            arr[i * 8 + k] = len;
+            offsets[i * 8 + k] = len;
             const day = timeArrays[i][k];
-            arr.set(day, len + prefixLen);
+            content.set(day, len);
             len += day.length;
         }
-        arr[i * 8 + 7] = len;
+        offsets[i * 8 + 7] = len;
     }
     return ptr;
 }
 
 /**
- * pre-compute `conflictCache` using `timeArrayList` and `dateList`
+ * returns a pointer to the dates in `dateList` concatenated together,
+ * with the start and end date of section `i` at `2 * i` and `2 * i + 1`
  */
-function computeConflict(
-    timeArrayList: TimeArray[],
-    dateList: MeetingDate[],
-    conflictCache: Uint8Array
-) {
-    const numSections = timeArrayList.length;
-    // pre-compute the conflict between each pair of sections
-    for (let i = 0; i < numSections; i++) {
-        for (let j = i + 1; j < numSections; j++) {
-            // conflict is symmetric
-            conflictCache[i * numSections + j] = conflictCache[j * numSections + i] = +(
-                checkTimeConflict(timeArrayList[i], timeArrayList[j], 3, 3) &&
-                calcOverlap(dateList[i][0], dateList[i][1], dateList[j][0], dateList[j][1]) !== -1
-            );
-        }
+function datesToCompact(Module: EMModule, dateList: MeetingDate[]) {
+    const ptr = Module._malloc(dateList.length * 16);
+    const arr = Module.HEAPF64.subarray(ptr / 8);
+    for (let i = 0; i < dateList.length; i++) {
+        arr.set(dateList[i], i * 2);
     }
+    return ptr;
+}
+
+/**
+ * the catalog whose sections are loaded in the native catalog store
+ * (see `loadCatalog` in ScheduleGenerator.cpp)
+ */
+let nativeCatalog: Window['catalog'] | undefined;
+/**
+ * a map from section id to the index of the section in the native catalog store
+ */
+const nativeSectionIdx = new Map<number, number>();
+
+/**
+ * load the time arrays and dates of all sections of `catalog` into the native catalog store,
+ * unless it is already loaded
+ */
+function loadNativeCatalog(Module: EMModule, catalog: Window['catalog']) {
+    if (nativeCatalog === catalog) return;
+    const sections = catalog.sections;
+    nativeSectionIdx.clear();
+    sections.forEach((section, i) => nativeSectionIdx.set(section.id, i));
+    Module._loadCatalog(
+        sections.length,
+        timeArrayToCompact(Module, sections.map(s => s.getTimeRoom())),
+        // sections without valid dates are never passed to the generator, so their dates do not matter
+        datesToCompact(Module, sections.map(s => parseDate(s.dates) || [0, 0]))
+    );
+    nativeCatalog = catalog;
 }
 
 export interface GeneratorOptions {
@@ -151,8 +174,8 @@ class ScheduleGenerator {
         for (const event of this.options.timeSlots) timeSlots.push(event.toTimeArray());
 
         const classList: RawAlgoCourse[] = [];
-        const timeArrayList: TimeArray[] = [];
-        const dateList: MeetingDate[] = [];
+        // the indices of the sections in the native catalog store
+        const sectionIds: number[] = [];
 
         const secLens = [0];
         const courses = schedule.All;
@@ -172,7 +195,7 @@ class ScheduleGenerator {
 
                 const courseRec = this.catalog.getCourse(key, subgroup);
 
-                const [classes, timeArrays, dates, allInvalid] = this.filterSections(
+                const [classes, ids, allInvalid] = this.filterSections(
                     courseRec,
                     timeSlots
                 );
@@ -189,8 +212,7 @@ class ScheduleGenerator {
                 } else {
                     secLens.push(classes.length);
                     classList.push(...classes);
-                    timeArrayList.push(...timeArrays);
-                    dateList.push(...dates);
+                    sectionIds.push(...ids);
                 }
                 if (allInvalid) {
                     msgs.push({
@@ -222,30 +244,23 @@ class ScheduleGenerator {
             secLens[i] += secLens[i - 1];
         }
         const Module = window.NativeModule;
+        // the time arrays, dates and conflicts of the sections are kept natively
+        loadNativeCatalog(Module, this.catalog);
 
         // pointer to the cache for the number of sections in each course
         const secLenPtr = Module._malloc(secLens.length * 4);
         Module.HEAP32.set(secLens, secLenPtr / 4);
 
-        // the side length of the conflict cache matrix
-        const _size = classList.length ** 2;
-        const conflictCachePtr = Module._malloc(_size);
-
-        // prepare the conflictCache
-        computeConflict(
-            timeArrayList,
-            dateList,
-            Module.HEAPU8.subarray(conflictCachePtr, conflictCachePtr + _size)
-        );
+        const sectionIdPtr = Module._malloc(sectionIds.length * 4);
+        Module.HEAP32.set(sectionIds, sectionIdPtr / 4);
         console.timeEnd('algorithm bootstrapping');
 
         console.time('running algorithm:');
-        const size = Module._generate(
+        const size = Module._generateFromCatalog(
             secLens.length - 1,
             this.options.maxNumSchedules,
             secLenPtr,
-            conflictCachePtr,
-            timeArrayToCompact(Module, timeArrayList)
+            sectionIdPtr
         );
         console.timeEnd('running algorithm:');
 
@@ -282,8 +297,7 @@ class ScheduleGenerator {
 
     private filterSections(courseRec: Course, timeSlots: TimeArray[]) {
         const classes: RawAlgoCourse[] = [],
-            timeArrays: TimeArray[] = [],
-            dates: MeetingDate[] = [];
+            ids: number[] = [];
 
         // combine all sections of this course occurring at the same time, if enabled
         const combined = this.options.combineSections
@@ -318,12 +332,11 @@ class ScheduleGenerator {
 
             if (secIndices.length) {
                 classes.push([courseRec.key, secIndices]);
-                timeArrays.push(timeArray);
-                dates.push(date);
+                ids.push(nativeSectionIdx.get(sections[0].id)!);
             }
         }
 
-        return [classes, timeArrays, dates, allInvalid] as const;
+        return [classes, ids, allInvalid] as const;
     }
 }
 
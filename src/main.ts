@@ -45,7 +45,23 @@ declare global {
         _setTimeMatrix(a: Ptr, b: number): void;
         _getSchedule(a: number): Ptr;
         _getRange(a: number): number;
+        _getLayerStart(a: number): number;
         _setRefSchedule(a: Ptr): number;
+        _setGenFlags(a: number): void;
+        _setNumThreads(a: number): void;
+        _countSchedules(a: number, b: Ptr, c: Ptr, d: Ptr): number;
+        _setCoeffCacheBudget(a: number): void;
+        _buildConflictCache(a: number, b: Ptr, c: Ptr, d: Ptr): void;
+        _loadCatalog(a: number, b: Ptr, c: Ptr): void;
+        _generateFromCatalog(a: number, b: number, c: Ptr, d: Ptr): number;
+        _addCourse(a: number, b: Ptr): number;
+        _removeCourse(a: number): number;
+        _addSection(a: number, b: number): number;
+        _removeSection(a: number, b: number): number;
+        _startGenerate(a: number, b: number, c: Ptr, d: Ptr, e: Ptr): number;
+        _generateStep(a: number): number;
+        _setConstraints(a: number, b: number, c: number, d: number, e: number): void;
+        _setRandomSeed(a: number): void;
         // ------------------------------------------------------------------------
 
         // ------------ APIs of Searcher.cpp --------------------------------------
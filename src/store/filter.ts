@@ -340,6 +340,13 @@ export class FilterStore implements StoreModule<FilterState, FilterStateJSON> {
             description:
                 'Sort using the options on top first. If compare equal, sort using the next option.' +
                 ' You can drag the sorting options to change their order.'
+        },
+        {
+            mode: SortMode.pareto,
+            title: 'Pareto',
+            description:
+                'Show the tradeoffs first: schedules that no other schedule beats in every enabled option come first,' +
+                ' then those beaten only by them, and so on. Weights are not used.'
         }
     ] as const;
 